@@ -21,10 +21,16 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <stdexcept>
 #include "TinyPngOut.hpp"
 
+#ifdef TINY_PNG_OUT_ZLIB
+#include <zlib.h>
+#endif
+
 using std::uint8_t;
 using std::uint16_t;
 using std::uint32_t;
@@ -32,7 +38,33 @@ using std::uint64_t;
 using std::size_t;
 
 
+#ifdef TINY_PNG_OUT_ZLIB
+struct TinyPngOut::Compressor final {
+	z_stream stream = {};
+	std::vector<uint8_t> buffer;  // Compressed data of the next IDAT chunk
+	
+	explicit Compressor(int level) :
+			buffer(IDAT_CHUNK_SIZE) {
+		if (deflateInit(&stream, level) != Z_OK)
+			throw std::runtime_error("Unable to initialize zlib");
+		stream.next_out = buffer.data();
+		stream.avail_out = static_cast<uInt>(buffer.size());
+	}
+	
+	~Compressor() {
+		deflateEnd(&stream);
+	}
+};
+#else
+struct TinyPngOut::Compressor final {};
+#endif
+
+
 TinyPngOut::TinyPngOut(uint32_t w, uint32_t h, std::ostream &out) :
+	TinyPngOut(w, h, out, 0) {}
+
+
+TinyPngOut::TinyPngOut(uint32_t w, uint32_t h, std::ostream &out, int level) :
 		// Set most of the fields
 		width(w),
 		height(h),
@@ -40,11 +72,16 @@ TinyPngOut::TinyPngOut(uint32_t w, uint32_t h, std::ostream &out) :
 		positionX(0),
 		positionY(0),
 		deflateFilled(0),
-		adler(1) {
+		adler(1),
+		compressionLevel(level) {
 	
 	// Check arguments
 	if (width == 0 || height == 0)
 		throw std::domain_error("Zero width or height");
+	if (level < 0 || level > 9)
+		throw std::domain_error("Invalid compression level");
+	if (level > 0 && !isCompressionSupported())
+		throw std::domain_error("Compression not supported");
 	
 	// Compute and check data siezs
 	uint64_t lineSz = static_cast<uint64_t>(width) * 3 + 1;
@@ -57,6 +94,27 @@ TinyPngOut::TinyPngOut(uint32_t w, uint32_t h, std::ostream &out) :
 		throw std::length_error("Image too large");
 	uncompRemain = static_cast<uint32_t>(uncompRm);
 	
+	if (compressionLevel > 0) {
+		// Image data goes into as many IDAT chunks as the compressor needs,
+		// so only the signature and IHDR chunk can be written up front
+		const uint8_t signature[] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+		write(signature);
+		uint8_t ihdr[] = {  // 13 bytes long
+			0, 0, 0, 0,  // 'width' placeholder
+			0, 0, 0, 0,  // 'height' placeholder
+			0x08, 0x02, 0x00, 0x00, 0x00,
+		};
+		putBigUint32(width, &ihdr[0]);
+		putBigUint32(height, &ihdr[4]);
+		writeChunk("IHDR", ihdr, sizeof(ihdr));
+		currentLine.resize(lineSize - 1);
+		previousLine.assign(lineSize - 1, 0);
+		filteredLine.resize(lineSize);
+		candidateLine.resize(lineSize);
+		compressor.reset(new Compressor(compressionLevel));
+		return;
+	}
+	
 	uint32_t numBlocks = uncompRemain / DEFLATE_MAX_BLOCK_SIZE;
 	if (uncompRemain % DEFLATE_MAX_BLOCK_SIZE != 0)
 		numBlocks++;  // Round up
@@ -97,10 +155,50 @@ TinyPngOut::TinyPngOut(uint32_t w, uint32_t h, std::ostream &out) :
 }
 
 
+TinyPngOut::~TinyPngOut() = default;
+
+
+bool TinyPngOut::isCompressionSupported() {
+#ifdef TINY_PNG_OUT_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+
 void TinyPngOut::write(const uint8_t pixels[], size_t count) {
 	if (count > SIZE_MAX / 3)
 		throw std::length_error("Invalid argument");
 	count *= 3;  // Convert pixel count to byte count
+	
+	if (compressionLevel > 0) {
+		// Lines are buffered whole, as filtering needs all of them; positionX
+		// counts the pixel bytes of the current line
+		while (count > 0) {
+			if (pixels == nullptr)
+				throw std::invalid_argument("Null pointer");
+			if (positionY >= height)
+				throw std::logic_error("All image pixels already written");
+			size_t n = std::min(count, currentLine.size() - positionX);
+			std::memcpy(&currentLine[positionX], pixels, n);
+			count -= n;
+			pixels += n;
+			positionX += static_cast<uint32_t>(n);
+			if (positionX == currentLine.size()) {
+				writeCompressedLine();
+				positionX = 0;
+				positionY++;
+				if (positionY == height) {  // Reached end of pixels
+					deflateData(nullptr, 0, true);
+					writeChunk("IEND", nullptr, 0);
+					compressor.reset();
+				}
+			}
+		}
+		return;
+	}
+	
 	while (count > 0) {
 		if (pixels == nullptr)
 			throw std::invalid_argument("Null pointer");
@@ -180,24 +278,181 @@ void TinyPngOut::write(const uint8_t pixels[], size_t count) {
 }
 
 
-void TinyPngOut::crc32(const uint8_t data[], size_t len) {
-	crc = ~crc;
-	for (size_t i = 0; i < len; i++) {
-		for (int j = 0; j < 8; j++) {  // Inefficient bitwise implementation, instead of table-based
-			uint32_t bit = (crc ^ (data[i] >> j)) & 1;
-			crc = (crc >> 1) ^ ((-bit) & UINT32_C(0xEDB88320));
+// Filters one line of RGB8.8.8 pixel bytes with the given PNG filter type, writing
+// the n filtered bytes to 'out'. 'up' holds the bytes of the line above.
+static void filterLine(int filter, const uint8_t cur[], const uint8_t up[], size_t n, uint8_t out[]) {
+	constexpr size_t BPP = 3;  // Bytes per pixel
+	switch (filter) {
+		case 0:  // None
+			std::memcpy(out, cur, n);
+			break;
+		case 1:  // Sub
+			for (size_t i = 0; i < n; i++)
+				out[i] = static_cast<uint8_t>(cur[i] - (i >= BPP ? cur[i - BPP] : 0));
+			break;
+		case 2:  // Up
+			for (size_t i = 0; i < n; i++)
+				out[i] = static_cast<uint8_t>(cur[i] - up[i]);
+			break;
+		case 3:  // Average
+			for (size_t i = 0; i < n; i++)
+				out[i] = static_cast<uint8_t>(cur[i] - (((i >= BPP ? cur[i - BPP] : 0) + up[i]) >> 1));
+			break;
+		default:  // Paeth
+			for (size_t i = 0; i < n; i++) {
+				int a = i >= BPP ? cur[i - BPP] : 0;
+				int b = up[i];
+				int c = i >= BPP ? up[i - BPP] : 0;
+				int p = a + b - c;
+				int pa = std::abs(p - a);
+				int pb = std::abs(p - b);
+				int pc = std::abs(p - c);
+				int predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+				out[i] = static_cast<uint8_t>(cur[i] - predictor);
+			}
+			break;
+	}
+}
+
+
+void TinyPngOut::writeCompressedLine() {
+	// Pick the filter minimizing the sum of the filtered bytes taken as signed
+	// magnitudes, the heuristic suggested by the PNG specification
+	const size_t n = currentLine.size();
+	uint64_t bestCost = UINT64_MAX;
+	for (int filter = 0; filter < 5; filter++) {
+		candidateLine[0] = static_cast<uint8_t>(filter);
+		filterLine(filter, currentLine.data(), previousLine.data(), n, &candidateLine[1]);
+		uint64_t cost = 0;
+		for (size_t i = 1; i <= n; i++)
+			cost += static_cast<uint64_t>(std::abs(static_cast<int>(static_cast<int8_t>(candidateLine[i]))));
+		if (cost < bestCost) {
+			bestCost = cost;
+			std::swap(filteredLine, candidateLine);
+		}
+	}
+	deflateData(filteredLine.data(), filteredLine.size(), false);
+	std::swap(currentLine, previousLine);
+}
+
+
+void TinyPngOut::deflateData(const uint8_t data[], size_t len, bool finish) {
+#ifdef TINY_PNG_OUT_ZLIB
+	z_stream &stream = compressor->stream;
+	std::vector<uint8_t> &buffer = compressor->buffer;
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = static_cast<uInt>(len);
+	while (true) {
+		int status = deflate(&stream, finish ? Z_FINISH : Z_NO_FLUSH);
+		if (status == Z_STREAM_ERROR)
+			throw std::runtime_error("Compression failed");
+		bool full = stream.avail_out == 0;
+		if (full || status == Z_STREAM_END) {  // Emit the buffered data as an IDAT chunk
+			size_t size = buffer.size() - stream.avail_out;
+			if (size > 0)
+				writeChunk("IDAT", buffer.data(), size);
+			stream.next_out = buffer.data();
+			stream.avail_out = static_cast<uInt>(buffer.size());
+		}
+		// Without a full buffer, all input has been consumed
+		if (status == Z_STREAM_END || (!full && !finish))
+			break;
+	}
+#else
+	(void)data;
+	(void)len;
+	(void)finish;
+	throw std::logic_error("Compression not supported");
+#endif
+}
+
+
+void TinyPngOut::writeChunk(const char type[4], const uint8_t data[], size_t len) {
+	uint8_t header[8];
+	putBigUint32(static_cast<uint32_t>(len), &header[0]);
+	std::memcpy(&header[4], type, 4);
+	write(header);
+	crc = 0;
+	crc32(&header[4], 4);
+	if (len > 0) {
+		output.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(len));
+		crc32(data, len);
+	}
+	uint8_t footer[4];
+	putBigUint32(crc, footer);
+	write(footer);
+}
+
+
+namespace {
+	// Lookup tables for slice-by-8 CRC-32: table[0] is the classic bytewise
+	// table, table[k] advances a byte's contribution by k more bytes
+	struct CrcTables final {
+		uint32_t table[8][256];
+		
+		CrcTables() {
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (int j = 0; j < 8; j++)
+					c = (c >> 1) ^ ((-(c & 1)) & UINT32_C(0xEDB88320));
+				table[0][i] = c;
+			}
+			for (int k = 1; k < 8; k++) {
+				for (int i = 0; i < 256; i++)
+					table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+			}
 		}
+	};
+}
+
+
+void TinyPngOut::crc32(const uint8_t data[], size_t len) {
+	static const CrcTables tables;
+	const uint32_t (&t)[8][256] = tables.table;
+	uint32_t c = ~crc;
+	for (; len >= 8; len -= 8, data += 8) {  // Eight bytes per step
+		uint32_t lo = c ^ (static_cast<uint32_t>(data[0]) << 0 | static_cast<uint32_t>(data[1]) << 8
+			| static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24);
+		uint32_t hi = static_cast<uint32_t>(data[4]) << 0 | static_cast<uint32_t>(data[5]) << 8
+			| static_cast<uint32_t>(data[6]) << 16 | static_cast<uint32_t>(data[7]) << 24;
+		c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+		  ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
 	}
-	crc = ~crc;
+	for (; len > 0; len--, data++)
+		c = (c >> 8) ^ t[0][(c ^ *data) & 0xFF];
+	crc = ~c;
 }
 
 
 void TinyPngOut::adler32(const uint8_t data[], size_t len) {
+	// The sums stay below 2^32 for ADLER_NMAX bytes, so the modulo is only
+	// taken once per chunk. Within a chunk, blocks of 16 bytes are summed as
+	// s1 += sum(data[i]) and s2 += 16 * s1 + sum((16 - i) * data[i]), which
+	// has no dependency between bytes and vectorizes.
+	constexpr uint32_t ADLER_MOD = 65521;
+	constexpr size_t ADLER_NMAX = 5552;  // Largest n with 255n(n+1)/2 + (n+1)(MOD-1) < 2^32
+	constexpr size_t BLOCK = 16;
 	uint32_t s1 = adler & 0xFFFF;
 	uint32_t s2 = adler >> 16;
-	for (size_t i = 0; i < len; i++) {
-		s1 = (s1 + data[i]) % 65521;
-		s2 = (s2 + s1) % 65521;
+	while (len > 0) {
+		size_t chunk = std::min(len, ADLER_NMAX);
+		len -= chunk;
+		for (; chunk >= BLOCK; chunk -= BLOCK, data += BLOCK) {
+			uint32_t sum = 0;
+			uint32_t weighted = 0;
+			for (size_t i = 0; i < BLOCK; i++) {
+				sum += data[i];
+				weighted += static_cast<uint32_t>(BLOCK - i) * data[i];
+			}
+			s2 += static_cast<uint32_t>(BLOCK) * s1 + weighted;
+			s1 += sum;
+		}
+		for (; chunk > 0; chunk--, data++) {
+			s1 += *data;
+			s2 += s1;
+		}
+		s1 %= ADLER_MOD;
+		s2 %= ADLER_MOD;
 	}
 	adler = s2 << 16 | s1;
 }
@@ -23,7 +23,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <ostream>
+#include <vector>
 
 
 /* 
@@ -47,6 +49,15 @@ class TinyPngOut final {
 	private: std::uint32_t crc;    // Primarily for IDAT chunk
 	private: std::uint32_t adler;  // For DEFLATE data within IDAT
 	
+	// Compressed mode state, only used when compressionLevel > 0
+	private: int compressionLevel;  // 0 for stored DEFLATE blocks, 1 to 9 for zlib levels
+	private: std::vector<std::uint8_t> currentLine;   // Pixel bytes of the line being written
+	private: std::vector<std::uint8_t> previousLine;  // Pixel bytes of the line above, for filtering
+	private: std::vector<std::uint8_t> filteredLine;  // Filter type byte and filtered bytes of the best filter
+	private: std::vector<std::uint8_t> candidateLine; // Scratch space for trying filters
+	private: struct Compressor;
+	private: std::unique_ptr<Compressor> compressor;
+	
 	
 	
 	/*---- Public constructor and method ----*/
@@ -59,6 +70,22 @@ class TinyPngOut final {
 	public: explicit TinyPngOut(std::uint32_t w, std::uint32_t h, std::ostream &out);
 	
 	
+	/* 
+	 * Creates a PNG writer like the constructor above, compressing the image data with the
+	 * given zlib level from 1 (fastest) to 9 (smallest), after choosing a PNG filter per line.
+	 * Level 0 writes uncompressed DEFLATE blocks. Throws an exception if level is out of range,
+	 * or if it is above 0 and the library was built without zlib (see isCompressionSupported()).
+	 */
+	public: explicit TinyPngOut(std::uint32_t w, std::uint32_t h, std::ostream &out, int level);
+	
+	
+	public: ~TinyPngOut();
+	
+	
+	// Tells whether the library was built with zlib, allowing compression levels above 0.
+	public: static bool isCompressionSupported();
+	
+	
 	/* 
 	 * Writes 'count' pixels from the given array to the output stream. This reads count*3
 	 * bytes from the array. Pixels are presented from top to bottom, left to right, and with
@@ -71,6 +98,21 @@ class TinyPngOut final {
 	
 	
 	
+	/*---- Private compressed mode methods ----*/
+	
+	// Filters the completed current line into 'filteredLine' and compresses it.
+	private: void writeCompressedLine();
+	
+	
+	// Feeds the given bytes to the compressor, writing IDAT chunks as its buffer fills up.
+	private: void deflateData(const std::uint8_t data[], size_t len, bool finish);
+	
+	
+	// Writes a complete chunk with the given 4 byte type, data and CRC-32.
+	private: void writeChunk(const char type[4], const std::uint8_t data[], size_t len);
+	
+	
+	
 	/*---- Private checksum methods ----*/
 	
 	// Reads the 'crc' field and updates its value based on the given array of new data.
@@ -94,5 +136,6 @@ class TinyPngOut final {
 	
 	
 	private: static constexpr std::uint16_t DEFLATE_MAX_BLOCK_SIZE = 65535;
+	private: static constexpr std::size_t IDAT_CHUNK_SIZE = 1 << 16;  // Compressed bytes per IDAT chunk
 	
 };
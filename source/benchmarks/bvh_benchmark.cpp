@@ -0,0 +1,109 @@
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bvh.hpp"
+#include "composite.hpp"
+#include "lambertian.hpp"
+#include "sampling.hpp"
+#include "sphere.hpp"
+
+namespace {
+
+// Randomly placed spheres at a constant density, with a fixed set of rays
+// shot into the cloud from outside.
+struct SphereCloud {
+    explicit SphereCloud(std::size_t count)
+        : material(Vector3(0.5f, 0.5f, 0.5f)) {
+        Sampler sampler(count);
+        float const side = 2.0f * std::cbrt(float(count));
+        spheres.reserve(count);
+        for (std::size_t i = 0; i != count; ++i) {
+            Vector3 const center = side * (random_vector(sampler) -
+                                           Vector3(0.5f, 0.5f, 0.5f));
+            spheres.emplace_back(center, 0.4f, material);
+        }
+        for (auto &sphere : spheres) {
+            composite.add_hittable(sphere);
+            bvh.add_hittable(sphere);
+        }
+        for (int i = 0; i != 1024; ++i) {
+            Vector3 const from = side * random_vector_in_unit_sphere(sampler);
+            Vector3 const to =
+                side * (random_vector(sampler) - Vector3(0.5f, 0.5f, 0.5f));
+            rays.emplace_back(from + Vector3(0.0f, 0.0f, 2.0f * side),
+                              to - from - Vector3(0.0f, 0.0f, 2.0f * side));
+        }
+    }
+
+    Lambertian material;
+    std::vector<Sphere> spheres;
+    Composite composite;
+    Bvh bvh;
+    std::vector<Ray> rays;
+};
+
+// Building the larger clouds takes a while, so share them between runs.
+SphereCloud &sphere_cloud(std::size_t count) {
+    static std::map<std::size_t, std::unique_ptr<SphereCloud>> clouds;
+    auto &cloud = clouds[count];
+    if (!cloud) {
+        cloud = std::make_unique<SphereCloud>(count);
+        cloud->bvh.build();
+    }
+    return *cloud;
+}
+
+template <typename World>
+void trace_rays(benchmark::State &state, World const &world,
+                std::vector<Ray> const &rays) {
+    std::size_t next = 0;
+    HitRecord record;
+    for (auto _ : state) {
+        bool const hit = world.hit(rays[next], 0.001f,
+                                   std::numeric_limits<float>::max(), record);
+        benchmark::DoNotOptimize(hit);
+        benchmark::DoNotOptimize(record);
+        next = (next + 1) % rays.size();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+void BM_CompositeHit(benchmark::State &state) {
+    auto &cloud = sphere_cloud(std::size_t(state.range(0)));
+    trace_rays(state, cloud.composite, cloud.rays);
+}
+
+void BM_BvhHit(benchmark::State &state) {
+    auto &cloud = sphere_cloud(std::size_t(state.range(0)));
+    trace_rays(state, cloud.bvh, cloud.rays);
+}
+
+void BM_BvhBuild(benchmark::State &state) {
+    auto &cloud = sphere_cloud(std::size_t(state.range(0)));
+    Bvh bvh;
+    for (auto _ : state) {
+        bvh.hittables = cloud.composite.hittables;
+        bvh.build();
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()) * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_CompositeHit)->Arg(10)->Arg(1000)->Arg(100000)->Arg(1000000);
+BENCHMARK(BM_BvhHit)->Arg(10)->Arg(1000)->Arg(100000)->Arg(1000000);
+BENCHMARK(BM_BvhBuild)
+    ->Arg(10)
+    ->Arg(1000)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "sample_sequences.hpp"
+#include "sampling.hpp"
+#include "vector3.hpp"
+#if defined(__GNUC__)
+#include "vector3_simd.hpp"
+#endif
+
+namespace {
+
+// Random vectors to work on, so that nothing folds into constants.
+template <typename V> std::vector<V> const &vectors() {
+    static std::vector<V> const vs = [] {
+        Sampler sampler(1);
+        std::vector<V> vs;
+        for (int i = 0; i != 1024; ++i) {
+            Vector3 const v = random_vector(sampler);
+            vs.emplace_back(v.x() - 0.5f, v.y() - 0.5f, v.z() - 0.5f);
+        }
+        return vs;
+    }();
+    return vs;
+}
+
+// Apply op to pairs of neighbouring vectors, counting one item per call.
+template <typename V, typename Operation>
+void vector_pairs(benchmark::State &state, Operation &&op) {
+    auto const &vs = vectors<V>();
+    for (auto _ : state) {
+        for (std::size_t i = 0; i + 1 < vs.size(); ++i) {
+            auto result = op(vs[i], vs[i + 1]);
+            benchmark::DoNotOptimize(result);
+        }
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()) *
+                            std::int64_t(vs.size() - 1));
+}
+
+using Double3 = std::array<double, 3>;
+
+Double3 components(float f) { return {f, 0.0, 0.0}; }
+
+template <typename V> Double3 components(V const &v) {
+    return {v.x(), v.y(), v.z()};
+}
+
+// Report the largest error of op over the vector pairs against reference,
+// the same operation in double precision, relative to the length of the
+// exact result and in units of the float machine epsilon.
+template <typename V, typename Operation, typename Reference>
+void report_error(benchmark::State &state, Operation &&op,
+                  Reference &&reference) {
+    auto const &vs = vectors<V>();
+    double max_error = 0.0;
+    for (std::size_t i = 0; i + 1 < vs.size(); ++i) {
+        Double3 const result = components(op(vs[i], vs[i + 1]));
+        Double3 const exact =
+            reference(components(vs[i]), components(vs[i + 1]));
+        double error = 0.0;
+        double norm = 0.0;
+        for (int c = 0; c != 3; ++c) {
+            error += (result[c] - exact[c]) * (result[c] - exact[c]);
+            norm += exact[c] * exact[c];
+        }
+        if (norm > 0.0) {
+            max_error = std::max(max_error, std::sqrt(error / norm));
+        }
+    }
+    state.counters["max_error_eps"] =
+        max_error / double(std::numeric_limits<float>::epsilon());
+}
+
+double dot(Double3 const &a, Double3 const &b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+template <typename V> void BM_Vector3Add(benchmark::State &state) {
+    vector_pairs<V>(state, [](V const &a, V const &b) { return a + b; });
+}
+
+template <typename V> void BM_Vector3Multiply(benchmark::State &state) {
+    vector_pairs<V>(state, [](V const &a, V const &b) { return a * b; });
+}
+
+template <typename V> void BM_Vector3Scale(benchmark::State &state) {
+    vector_pairs<V>(state, [](V const &a, V const &b) { return b.x() * a; });
+}
+
+template <typename V> void BM_Vector3Divide(benchmark::State &state) {
+    auto const op = [](V const &a, V const &b) { return a / (b.x() + 1.0f); };
+    vector_pairs<V>(state, op);
+    report_error<V>(state, op, [](Double3 const &a, Double3 const &b) {
+        double const t = b[0] + 1.0;
+        return Double3{a[0] / t, a[1] / t, a[2] / t};
+    });
+}
+
+template <typename V> void BM_Vector3Dot(benchmark::State &state) {
+    auto const op = [](V const &a, V const &b) { return dot(a, b); };
+    vector_pairs<V>(state, op);
+    report_error<V>(state, op, [](Double3 const &a, Double3 const &b) {
+        return Double3{dot(a, b), 0.0, 0.0};
+    });
+}
+
+template <typename V> void BM_Vector3Cross(benchmark::State &state) {
+    auto const op = [](V const &a, V const &b) { return cross(a, b); };
+    vector_pairs<V>(state, op);
+    report_error<V>(state, op, [](Double3 const &a, Double3 const &b) {
+        return Double3{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                       a[0] * b[1] - a[1] * b[0]};
+    });
+}
+
+template <typename V> void BM_Vector3Length(benchmark::State &state) {
+    auto const op = [](V const &a, V const &) { return a.length(); };
+    vector_pairs<V>(state, op);
+    report_error<V>(state, op, [](Double3 const &a, Double3 const &) {
+        return Double3{std::sqrt(dot(a, a)), 0.0, 0.0};
+    });
+}
+
+template <typename V> void BM_UnitVector(benchmark::State &state) {
+    auto const op = [](V const &a, V const &) { return unit_vector(a); };
+    vector_pairs<V>(state, op);
+    report_error<V>(state, op, [](Double3 const &a, Double3 const &) {
+        double const length = std::sqrt(dot(a, a));
+        return Double3{a[0] / length, a[1] / length, a[2] / length};
+    });
+}
+
+template <typename V> void BM_Vector3Reciprocal(benchmark::State &state) {
+    auto const op = [](V const &a, V const &) { return rcp(a); };
+    vector_pairs<V>(state, op);
+    report_error<V>(state, op, [](Double3 const &a, Double3 const &) {
+        return Double3{1.0 / a[0], 1.0 / a[1], 1.0 / a[2]};
+    });
+}
+
+template <typename V> void BM_Vector3MultiplyAdd(benchmark::State &state) {
+    vector_pairs<V>(state, [](V const &a, V const &b) {
+        return multiply_add(b.x(), a, b);
+    });
+}
+
+void BM_SamplerNextFloat(benchmark::State &state) {
+    Sampler sampler(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sampler.next_float());
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+// Eight dimensions of successive points of a sequence, as a path takes them.
+void BM_SamplerSequence(benchmark::State &state, SampleSequence sequence) {
+    Sampler sampler(1);
+    std::uint32_t index = 0;
+    for (auto _ : state) {
+        sampler.use_sequence(sequence, index % 64, 64, index / 64);
+        ++index;
+        for (int d = 0; d != 4; ++d) {
+            benchmark::DoNotOptimize(sampler.next_2d());
+        }
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+// Whole patterns of count correlated multi-jittered points, checked for
+// stratification: the largest deviation of the share of points in any of
+// eight rows or columns from an eighth, and of their mean from a half. Counts
+// which are no product m n, like 50, must come out as even as squares.
+void BM_MultiJittered(benchmark::State &state) {
+    auto const count = std::uint32_t(state.range(0));
+    std::array<std::int64_t, 8> rows{};
+    std::array<std::int64_t, 8> columns{};
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+    std::uint32_t pattern = 0;
+    for (auto _ : state) {
+        for (std::uint32_t i = 0; i != count; ++i) {
+            auto const [x, y] =
+                sample_sequences::multi_jittered(i, count, pattern);
+            ++columns[int(x * 8.0f)];
+            ++rows[int(y * 8.0f)];
+            sum_x += x;
+            sum_y += y;
+        }
+        ++pattern;
+    }
+    double const total = double(pattern) * double(count);
+    double max_share_error = 0.0;
+    for (int k = 0; k != 8; ++k) {
+        max_share_error =
+            std::max({max_share_error,
+                      std::abs(double(rows[k]) / total - 0.125),
+                      std::abs(double(columns[k]) / total - 0.125)});
+    }
+    state.counters["max_share_error"] = max_share_error;
+    state.counters["max_mean_error"] = std::max(
+        std::abs(sum_x / total - 0.5), std::abs(sum_y / total - 0.5));
+    state.SetItemsProcessed(std::int64_t(total));
+}
+
+void BM_RandomUnitVector(benchmark::State &state) {
+    Sampler sampler(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(random_unit_vector(sampler));
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+void BM_RandomVectorInUnitSphere(benchmark::State &state) {
+    Sampler sampler(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(random_vector_in_unit_sphere(sampler));
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+} // namespace
+
+// Vector3 as configured, and the SIMD one to compare with, which is the same
+// with MATHY_SIMD.
+#define VECTOR3_BENCHMARKS(V)                                                 \
+    BENCHMARK_TEMPLATE(BM_Vector3Add, V);                                     \
+    BENCHMARK_TEMPLATE(BM_Vector3Multiply, V);                                \
+    BENCHMARK_TEMPLATE(BM_Vector3Scale, V);                                   \
+    BENCHMARK_TEMPLATE(BM_Vector3Divide, V);                                  \
+    BENCHMARK_TEMPLATE(BM_Vector3Dot, V);                                     \
+    BENCHMARK_TEMPLATE(BM_Vector3Cross, V);                                   \
+    BENCHMARK_TEMPLATE(BM_Vector3Length, V);                                  \
+    BENCHMARK_TEMPLATE(BM_UnitVector, V);                                     \
+    BENCHMARK_TEMPLATE(BM_Vector3Reciprocal, V);                              \
+    BENCHMARK_TEMPLATE(BM_Vector3MultiplyAdd, V)
+
+VECTOR3_BENCHMARKS(Vector3);
+#if defined(__GNUC__)
+VECTOR3_BENCHMARKS(SimdVector3);
+#endif
+BENCHMARK(BM_SamplerNextFloat);
+BENCHMARK_CAPTURE(BM_SamplerSequence, random, SampleSequence::random);
+BENCHMARK_CAPTURE(BM_SamplerSequence, stratified, SampleSequence::stratified);
+BENCHMARK_CAPTURE(BM_SamplerSequence, sobol, SampleSequence::sobol);
+BENCHMARK_CAPTURE(BM_SamplerSequence, blue_noise, SampleSequence::blue_noise);
+BENCHMARK(BM_MultiJittered)->Arg(50)->Arg(64)->Arg(250);
+BENCHMARK(BM_RandomUnitVector);
+BENCHMARK(BM_RandomVectorInUnitSphere);
+
+BENCHMARK_MAIN();
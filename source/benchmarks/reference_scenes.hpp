@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "composite.hpp"
+#include "lambertian.hpp"
+#include "material.hpp"
+#include "metal.hpp"
+#include "sampling.hpp"
+#include "sphere.hpp"
+#include "static_scene.hpp"
+
+// Scenes shared by the benchmarks, each held as a linear Composite, a Bvh and
+// a StaticScene over the same spheres. Scenes are built once and never move,
+// as the worlds point into them.
+struct ReferenceScene {
+    explicit ReferenceScene(Camera const &camera) : camera(camera) {}
+    ReferenceScene(ReferenceScene const &) = delete;
+    ReferenceScene &operator=(ReferenceScene const &) = delete;
+
+    Material const &add_material(std::unique_ptr<Material> material) {
+        materials.push_back(std::move(material));
+        return *materials.back();
+    }
+
+    // Add the spheres to all worlds and build their acceleration structures.
+    void build() {
+        for (auto &sphere : spheres) {
+            composite.add_hittable(sphere);
+            bvh.add_hittable(sphere);
+            static_scene.add_sphere(sphere);
+        }
+        bvh.build();
+        static_scene.build();
+    }
+
+    Camera camera;
+    std::vector<std::unique_ptr<Material>> materials;
+    std::vector<Sphere> spheres;
+    Composite composite;
+    Bvh bvh;
+    StaticScene static_scene;
+};
+
+// The scene rendered by the driver.
+inline ReferenceScene const &simple_scene() {
+    static std::unique_ptr<ReferenceScene> const scene = [] {
+        auto scene = std::make_unique<ReferenceScene>(
+            Camera(Vector3(0, 0.5, 1), Vector3(0, 0, -4), Vector3(0, 1, 0), 100,
+                   900.0f / 600.0f));
+        auto sphere = [&](Vector3 const &center, float radius,
+                          Material const &material) {
+            scene->spheres.emplace_back(center, radius, material);
+        };
+        auto lambertian = [&](Vector3 const &albedo) -> Material const & {
+            return scene->add_material(std::make_unique<Lambertian>(albedo));
+        };
+        auto metal = [&](Vector3 const &albedo) -> Material const & {
+            return scene->add_material(std::make_unique<Metal>(albedo));
+        };
+        scene->spheres.reserve(6);
+        sphere(Vector3(0.0f, 0.0f, -1.0f), 0.5f,
+               lambertian(Vector3(0.8f, 0.2f, 0.2f)));
+        sphere(Vector3(-1.1f, 0.0f, -1.0f), 0.5f,
+               metal(Vector3(0.7f, 0.8f, 0.2f)));
+        sphere(Vector3(1.1f, 0.0f, -1.0f), 0.5f,
+               metal(Vector3(0.7f, 0.7f, 0.9f)));
+        sphere(Vector3(3.1f, 2.0f, 4.0f), 0.5f,
+               lambertian(Vector3(0.9f, 0.1f, 0.2f)));
+        sphere(Vector3(0.0f, -50.5f, 1.0f), 50.0f,
+               lambertian(Vector3(0.8f, 0.9f, 0.1f)));
+        sphere(Vector3(5.0f, 26.5f, -7.0f), 25.0f,
+               metal(Vector3(0.3f, 0.3f, 0.9f)));
+        scene->build();
+        return scene;
+    }();
+    return *scene;
+}
+
+// A ground sphere covered by a grid of small spheres of random materials,
+// seen from above at an angle.
+inline ReferenceScene const &random_spheres_scene() {
+    static std::unique_ptr<ReferenceScene> const scene = [] {
+        auto scene = std::make_unique<ReferenceScene>(
+            Camera(Vector3(13, 2, 3), Vector3(0, 0, 0), Vector3(0, 1, 0), 30,
+                   900.0f / 600.0f));
+        Sampler sampler(2024);
+        int const half_grid = 11;
+        scene->spheres.reserve(std::size_t(4 * half_grid * half_grid + 1));
+        scene->spheres.emplace_back(
+            Vector3(0, -1000, 0), 1000.0f,
+            scene->add_material(
+                std::make_unique<Lambertian>(Vector3(0.5f, 0.5f, 0.5f))));
+        for (int a = -half_grid; a != half_grid; ++a) {
+            for (int b = -half_grid; b != half_grid; ++b) {
+                Vector3 const center(float(a) + 0.9f * sampler.next_float(),
+                                     0.2f,
+                                     float(b) + 0.9f * sampler.next_float());
+                Vector3 const albedo = random_vector(sampler);
+                std::unique_ptr<Material> material;
+                if (sampler.next_float() < 0.8f) {
+                    material = std::make_unique<Lambertian>(albedo * albedo);
+                } else {
+                    material = std::make_unique<Metal>(
+                        0.5f * (albedo + Vector3(1.0f, 1.0f, 1.0f)));
+                }
+                scene->spheres.emplace_back(
+                    center, 0.2f, scene->add_material(std::move(material)));
+            }
+        }
+        scene->build();
+        return scene;
+    }();
+    return *scene;
+}
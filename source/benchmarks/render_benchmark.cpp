@@ -0,0 +1,265 @@
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "integrator.hpp"
+#include "path_integrator.hpp"
+#include "reference_scenes.hpp"
+#include "thread_pool.hpp"
+#include "tile_renderer.hpp"
+#include "wavefront_integrator.hpp"
+
+namespace {
+
+// Forwards to a world, counting the rays traced against it.
+template <typename World> struct CountingWorld {
+    explicit CountingWorld(World const &world) : world(world) {}
+
+    bool hit(Ray const &r, float t_min, float t_max, HitRecord &rec) const {
+        ++rays;
+        return world.hit(r, t_min, t_max, rec);
+    }
+
+    World const &world;
+    mutable std::uint64_t rays = 0;
+};
+
+template <typename World>
+bool scatter(CountingWorld<World> const &counting, Ray const &ray,
+             HitRecord const &record, Vector3 &attenuation, Ray &scattered,
+             Sampler &sampler) {
+    return scatter(counting.world, ray, record, attenuation, scattered,
+                   sampler);
+}
+
+template <typename World>
+MaterialType material_type(CountingWorld<World> const &counting,
+                           HitRecord const &record) {
+    return material_type(counting.world, record);
+}
+
+// Render a small image of a reference scene on one thread and report the
+// rays traced per second.
+template <typename Integrator, typename World>
+void render(benchmark::State &state, Camera const &camera, World const &world) {
+    RenderSettings const settings{160, 120, 4, 0};
+    ThreadPool pool(1);
+    TileRenderer const renderer(pool);
+    Integrator const integrator;
+    CountingWorld<World> const counting(world);
+    for (auto _ : state) {
+        renderer.render(settings.width, settings.height,
+                        [&](Tile const &tile, std::size_t) {
+                            TileAccumulator accumulator;
+                            accumulator.reset(std::size_t(
+                                (tile.x_end - tile.x_begin) *
+                                (tile.y_end - tile.y_begin)));
+                            integrator.render_tile(
+                                tile, camera, counting, settings,
+                                SampleRequest{0, settings.samples},
+                                accumulator);
+                            benchmark::DoNotOptimize(accumulator.sum.data());
+                        });
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()) *
+                            settings.width * settings.height *
+                            settings.samples);
+    state.counters["rays"] =
+        benchmark::Counter(double(counting.rays), benchmark::Counter::kIsRate);
+}
+
+template <typename Integrator>
+void BM_RenderSimpleScene(benchmark::State &state) {
+    auto const &scene = simple_scene();
+    if (state.range(0) == 0) {
+        render<Integrator>(state, scene.camera, scene.bvh);
+    } else {
+        render<Integrator>(state, scene.camera, scene.static_scene);
+    }
+}
+
+template <typename Integrator>
+void BM_RenderRandomSpheres(benchmark::State &state) {
+    auto const &scene = random_spheres_scene();
+    if (state.range(0) == 0) {
+        render<Integrator>(state, scene.camera, scene.bvh);
+    } else {
+        render<Integrator>(state, scene.camera, scene.static_scene);
+    }
+}
+
+// A material of its own, outside the families the integrators batch; it
+// cannot claim one of them, so both integrators shade it through scatter().
+class Tinted : public Material {
+  public:
+    explicit Tinted(Vector3 const &tint) : tint(tint) {}
+    bool scatter(Ray const &, HitRecord const &record, Vector3 &attenuation,
+                 Ray &scattered, Sampler &sampler) const override {
+        scattered = Ray(record.p,
+                        record.normal + random_vector_in_unit_sphere(sampler));
+        attenuation = tint;
+        return true;
+    }
+
+  private:
+    Vector3 tint;
+};
+
+// The simple scene with its diffuse spheres in Tinted materials.
+struct TintedScene {
+    TintedScene() : camera(simple_scene().camera) {
+        for (auto const &sphere : simple_scene().spheres) {
+            Material const *material = sphere.material;
+            if (auto const *l = dynamic_cast<Lambertian const *>(material)) {
+                materials.push_back(std::make_unique<Tinted>(l->attenuation()));
+                material = materials.back().get();
+            }
+            spheres.emplace_back(sphere.center, sphere.radius, *material);
+        }
+        for (auto &sphere : spheres) {
+            bvh.add_hittable(sphere);
+        }
+        bvh.build();
+    }
+
+    Camera camera;
+    std::vector<std::unique_ptr<Material>> materials;
+    std::vector<Sphere> spheres;
+    Bvh bvh;
+};
+
+// Sums of all pixels of an image rendered on one thread, in tile order.
+template <typename Integrator, typename World>
+std::vector<Vector3> render_sums(Camera const &camera, World const &world,
+                                 RenderSettings const &settings) {
+    ThreadPool pool(1);
+    TileRenderer const renderer(pool);
+    Integrator const integrator;
+    std::vector<Vector3> sums;
+    renderer.render(settings.width, settings.height,
+                    [&](Tile const &tile, std::size_t) {
+                        TileAccumulator accumulator;
+                        accumulator.reset(
+                            std::size_t((tile.x_end - tile.x_begin) *
+                                        (tile.y_end - tile.y_begin)));
+                        integrator.render_tile(
+                            tile, camera, world, settings,
+                            SampleRequest{0, settings.samples}, accumulator);
+                        sums.insert(sums.end(), accumulator.sum.begin(),
+                                    accumulator.sum.end());
+                    });
+    return sums;
+}
+
+// Renders a scene with a user defined material with the wavefront integrator,
+// after checking that it reports no built-in family and that its image is
+// that of the path integrator, as shading it as a Lambertian would not be.
+void BM_RenderCustomMaterial(benchmark::State &state) {
+    static TintedScene const scene;
+    if (scene.materials.front()->type() != MaterialType::other) {
+        state.SkipWithError("a user defined material claims a family");
+        return;
+    }
+    RenderSettings const settings{160, 120, 4, 0};
+    auto const path =
+        render_sums<PathIntegrator>(scene.camera, scene.bvh, settings);
+    auto const wavefront =
+        render_sums<WavefrontIntegrator>(scene.camera, scene.bvh, settings);
+    for (std::size_t p = 0; p != path.size(); ++p) {
+        if (path[p].x() != wavefront[p].x() ||
+            path[p].y() != wavefront[p].y() ||
+            path[p].z() != wavefront[p].z()) {
+            state.SkipWithError("wavefront and path integrator images differ");
+            return;
+        }
+    }
+    render<WavefrontIntegrator>(state, scene.camera, scene.bvh);
+}
+
+// The random spheres with all but the ground moved to a keyframe: up by
+// varying heights, some also grown.
+std::vector<Sphere> keyframe_spheres() {
+    std::vector<Sphere> spheres = random_spheres_scene().spheres;
+    for (std::size_t i = 1; i < spheres.size(); ++i) {
+        spheres[i].center += Vector3(0.0f, 0.25f * float(i % 5), 0.0f);
+        spheres[i].radius *= 1.0f + 0.1f * float(i % 3);
+    }
+    return spheres;
+}
+
+// Refits a StaticScene of the random spheres to a keyframe, as animations do
+// every frame, after checking that rendering the refitted scene gives the
+// image of one built from scratch at the keyframe.
+void BM_RefitRandomSpheres(benchmark::State &state) {
+    auto const &scene = random_spheres_scene();
+    std::vector<Sphere> const moved = keyframe_spheres();
+    StaticScene refitted;
+    StaticScene rebuilt;
+    for (std::size_t i = 0; i != moved.size(); ++i) {
+        refitted.add_sphere(scene.spheres[i]);
+        rebuilt.add_sphere(moved[i]);
+    }
+    refitted.build();
+    rebuilt.build();
+    auto const move = [&] {
+        for (std::size_t i = 0; i != moved.size(); ++i) {
+            StaticSphere &sphere = refitted.sphere(std::uint32_t(i));
+            sphere.center = moved[i].center;
+            sphere.radius = moved[i].radius;
+        }
+        refitted.refit();
+    };
+    move();
+    RenderSettings const settings{80, 60, 4, 0};
+    std::vector<Vector3> const expected =
+        render_sums<PathIntegrator>(scene.camera, rebuilt, settings);
+    std::vector<Vector3> const actual =
+        render_sums<PathIntegrator>(scene.camera, refitted, settings);
+    for (std::size_t p = 0; p != expected.size(); ++p) {
+        if (actual[p].x() != expected[p].x() ||
+            actual[p].y() != expected[p].y() ||
+            actual[p].z() != expected[p].z()) {
+            state.SkipWithError("refitted and rebuilt images differ");
+            return;
+        }
+    }
+    for (auto _ : state) {
+        move();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()) *
+                            std::int64_t(moved.size()));
+}
+
+} // namespace
+
+// The argument selects the world: 0 for Bvh (virtual dispatch), 1 for
+// StaticScene (variant dispatch).
+BENCHMARK_TEMPLATE(BM_RenderSimpleScene, PathIntegrator)
+    ->ArgName("static")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_RenderSimpleScene, WavefrontIntegrator)
+    ->ArgName("static")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_RenderRandomSpheres, PathIntegrator)
+    ->ArgName("static")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_RenderRandomSpheres, WavefrontIntegrator)
+    ->ArgName("static")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_RenderCustomMaterial)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RefitRandomSpheres)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
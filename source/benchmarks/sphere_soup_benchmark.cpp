@@ -0,0 +1,114 @@
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "composite.hpp"
+#include "cpu_features.hpp"
+#include "lambertian.hpp"
+#include "sampling.hpp"
+#include "sphere.hpp"
+#include "sphere_soup.hpp"
+
+namespace {
+
+// A dense cluster of spheres, stored both as Sphere objects and as a soup.
+struct DenseSpheres {
+    explicit DenseSpheres(std::size_t count)
+        : material(Vector3(0.5f, 0.5f, 0.5f)) {
+        Sampler sampler(count);
+        spheres.reserve(count);
+        for (std::size_t i = 0; i != count; ++i) {
+            Vector3 const center =
+                10.0f * (random_vector(sampler) - Vector3(0.5f, 0.5f, 0.5f));
+            spheres.emplace_back(center, 0.2f, material);
+        }
+        for (auto &sphere : spheres) {
+            composite.add_hittable(sphere);
+            soup.add_sphere(sphere.center, sphere.radius, material);
+        }
+        for (int i = 0; i != 1024; ++i) {
+            rays.emplace_back(20.0f * random_vector_in_unit_sphere(sampler),
+                              random_vector_in_unit_sphere(sampler));
+        }
+    }
+
+    Lambertian material;
+    std::vector<Sphere> spheres;
+    Composite composite;
+    SphereSoup soup;
+    std::vector<Ray> rays;
+};
+
+void trace_rays(benchmark::State &state, Hittable const &world,
+                std::vector<Ray> const &rays) {
+    std::size_t next = 0;
+    HitRecord record;
+    for (auto _ : state) {
+        bool const hit = world.hit(rays[next], 0.001f,
+                                   std::numeric_limits<float>::max(), record);
+        benchmark::DoNotOptimize(hit);
+        benchmark::DoNotOptimize(record);
+        next = (next + 1) % rays.size();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+void BM_CompositeSpheres(benchmark::State &state) {
+    DenseSpheres scene(std::size_t(state.range(0)));
+    trace_rays(state, scene.composite, scene.rays);
+}
+
+// Whether the soup hits exactly what the Sphere objects hit.
+bool same_hits(DenseSpheres const &scene) {
+    float const t_max = std::numeric_limits<float>::max();
+    for (Ray const &ray : scene.rays) {
+        HitRecord expected, actual;
+        bool const hit = scene.composite.hit(ray, 0.001f, t_max, expected);
+        if (scene.soup.hit(ray, 0.001f, t_max, actual) != hit ||
+            (hit && (actual.t != expected.t ||
+                     actual.normal.x() != expected.normal.x() ||
+                     actual.normal.y() != expected.normal.y() ||
+                     actual.normal.z() != expected.normal.z()))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BM_SphereSoup(benchmark::State &state, SimdLevel level) {
+    DenseSpheres scene(std::size_t(state.range(0)));
+    scene.soup.set_simd_level(level);
+    if (!same_hits(scene)) {
+        state.SkipWithError("the soup hits differ from the spheres");
+        return;
+    }
+    trace_rays(state, scene.soup, scene.rays);
+}
+
+} // namespace
+
+BENCHMARK(BM_CompositeSpheres)->RangeMultiplier(4)->Range(16, 4096);
+
+int main(int argc, char **argv) {
+    for (SimdLevel level : {SimdLevel::scalar, SimdLevel::sse2,
+                            SimdLevel::avx2, SimdLevel::avx512}) {
+        if (!simd_level_supported(level)) {
+            continue;
+        }
+        std::string const name =
+            std::string("BM_SphereSoup/") + simd_level_name(level);
+        benchmark::RegisterBenchmark(name.c_str(), BM_SphereSoup, level)
+            ->RangeMultiplier(4)
+            ->Range(16, 4096);
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "integrator.hpp"
+#include "lambertian.hpp"
+#include "metal.hpp"
+#include "path_integrator.hpp"
+#include "reference_scenes.hpp"
+#include "sampling.hpp"
+
+namespace {
+
+// Camera rays through random points of the image.
+std::vector<Ray> const &camera_rays() {
+    static std::vector<Ray> const rays = [] {
+        Sampler sampler(3);
+        std::vector<Ray> rays;
+        for (int i = 0; i != 1024; ++i) {
+            float const u = sampler.next_float();
+            float const v = sampler.next_float();
+            rays.push_back(simple_scene().camera.get_ray(u, v));
+        }
+        return rays;
+    }();
+    return rays;
+}
+
+// Hits of the camera rays on materials of type M, with their rays.
+template <typename M> struct MaterialHits {
+    MaterialHits() {
+        for (Ray const &ray : camera_rays()) {
+            HitRecord record;
+            if (simple_scene().composite.hit(
+                    ray, 0.001f, std::numeric_limits<float>::max(), record) &&
+                dynamic_cast<M const *>(record.material) != nullptr) {
+                rays.push_back(ray);
+                records.push_back(record);
+            }
+        }
+    }
+
+    std::vector<Ray> rays;
+    std::vector<HitRecord> records;
+};
+
+template <typename World>
+void trace_rays(benchmark::State &state, World const &world) {
+    auto const &rays = camera_rays();
+    std::size_t next = 0;
+    HitRecord record;
+    for (auto _ : state) {
+        bool const hit = world.hit(rays[next], 0.001f,
+                                   std::numeric_limits<float>::max(), record);
+        benchmark::DoNotOptimize(hit);
+        benchmark::DoNotOptimize(record);
+        next = (next + 1) % rays.size();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+void BM_SphereHit(benchmark::State &state) {
+    trace_rays(state, simple_scene().spheres.front());
+}
+
+void BM_CompositeHit(benchmark::State &state) {
+    trace_rays(state, simple_scene().composite);
+}
+
+void BM_BvhHit(benchmark::State &state) {
+    trace_rays(state, simple_scene().bvh);
+}
+
+void BM_StaticSceneHit(benchmark::State &state) {
+    trace_rays(state, simple_scene().static_scene);
+}
+
+template <typename M> void BM_Scatter(benchmark::State &state) {
+    static MaterialHits<M> const hits;
+    Sampler sampler(5);
+    std::size_t next = 0;
+    for (auto _ : state) {
+        Vector3 attenuation;
+        Ray scattered;
+        HitRecord const &record = hits.records[next];
+        bool const scattered_any = record.material->scatter(
+            hits.rays[next], record, attenuation, scattered, sampler);
+        benchmark::DoNotOptimize(scattered_any);
+        benchmark::DoNotOptimize(scattered);
+        next = (next + 1) % hits.records.size();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+// Full paths from the camera through the simple scene.
+template <typename World>
+void scene_colors(benchmark::State &state, World const &world) {
+    auto const &rays = camera_rays();
+    Sampler sampler(7);
+    std::size_t next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scene_color(rays[next], world, sampler));
+        next = (next + 1) % rays.size();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+void BM_SceneColorComposite(benchmark::State &state) {
+    scene_colors(state, simple_scene().composite);
+}
+
+void BM_SceneColorBvh(benchmark::State &state) {
+    scene_colors(state, simple_scene().bvh);
+}
+
+void BM_SceneColorStaticScene(benchmark::State &state) {
+    scene_colors(state, simple_scene().static_scene);
+}
+
+} // namespace
+
+BENCHMARK(BM_SphereHit);
+BENCHMARK(BM_CompositeHit);
+BENCHMARK(BM_BvhHit);
+BENCHMARK(BM_StaticSceneHit);
+BENCHMARK_TEMPLATE(BM_Scatter, Lambertian);
+BENCHMARK_TEMPLATE(BM_Scatter, Metal);
+BENCHMARK(BM_SceneColorComposite);
+BENCHMARK(BM_SceneColorBvh);
+BENCHMARK(BM_SceneColorStaticScene);
+
+BENCHMARK_MAIN();
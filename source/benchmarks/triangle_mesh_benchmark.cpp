@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "constants.hpp"
+#include "cpu_features.hpp"
+#include "sampling.hpp"
+#include "triangle_mesh.hpp"
+
+namespace {
+
+// A unit sphere tessellated into about the given number of triangles, and
+// rays from outside aimed near its center.
+struct SphereMesh {
+    explicit SphereMesh(std::size_t triangles) {
+        std::uint32_t const rings =
+            std::max(2u, std::uint32_t(std::sqrt(float(triangles) / 4.0f)));
+        std::uint32_t const segments = 2 * rings;
+        for (std::uint32_t j = 0; j <= rings; ++j) {
+            float const theta = float(pi) * float(j) / float(rings);
+            for (std::uint32_t i = 0; i != segments; ++i) {
+                float const phi = 2.0f * float(pi) * float(i) / float(segments);
+                mesh.positions.emplace_back(std::sin(theta) * std::cos(phi),
+                                            std::cos(theta),
+                                            std::sin(theta) * std::sin(phi));
+            }
+        }
+        for (std::uint32_t j = 0; j != rings; ++j) {
+            for (std::uint32_t i = 0; i != segments; ++i) {
+                std::uint32_t const a = j * segments + i;
+                std::uint32_t const b = j * segments + (i + 1) % segments;
+                std::uint32_t const c = a + segments;
+                std::uint32_t const d = b + segments;
+                mesh.indices.insert(mesh.indices.end(), {a, b, d, a, d, c});
+            }
+        }
+        mesh.build();
+        Sampler sampler(triangles);
+        for (int i = 0; i != 1024; ++i) {
+            Vector3 const origin =
+                5.0f * unit_vector(random_vector_in_unit_sphere(sampler));
+            rays.emplace_back(
+                origin, 0.5f * random_vector_in_unit_sphere(sampler) - origin);
+        }
+    }
+
+    TriangleMesh mesh;
+    std::vector<Ray> rays;
+};
+
+void BM_TriangleMesh(benchmark::State &state, SimdLevel level) {
+    SphereMesh scene(std::size_t(state.range(0)));
+    scene.mesh.set_simd_level(level);
+    std::size_t next = 0;
+    HitRecord record;
+    for (auto _ : state) {
+        bool const hit =
+            scene.mesh.hit(scene.rays[next], 0.001f,
+                           std::numeric_limits<float>::max(), record);
+        benchmark::DoNotOptimize(hit);
+        benchmark::DoNotOptimize(record);
+        next = (next + 1) % scene.rays.size();
+    }
+    state.SetItemsProcessed(std::int64_t(state.iterations()));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    for (SimdLevel level :
+         {SimdLevel::scalar, SimdLevel::sse2, SimdLevel::avx2}) {
+        if (!simd_level_supported(level)) {
+            continue;
+        }
+        std::string const name =
+            std::string("BM_TriangleMesh/") + simd_level_name(level);
+        benchmark::RegisterBenchmark(name.c_str(), BM_TriangleMesh, level)
+            ->RangeMultiplier(16)
+            ->Range(64, 1 << 20);
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
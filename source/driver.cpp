@@ -1,180 +1,988 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 
+#include "animation.hpp"
+#include "arena_scene.hpp"
 #include "camera.hpp"
-#include "composite.hpp"
+#include "film.hpp"
 #include "hittable.hpp"
 #include "lambertian.hpp"
 #include "material.hpp"
 #include "metal.hpp"
+#include "path_integrator.hpp"
+#include "progressive_renderer.hpp"
+#include "render_parts.hpp"
+#include "render_stats.hpp"
 #include "sampling.hpp"
+#include "scene_file.hpp"
 #include "sphere.hpp"
+#include "static_scene.hpp"
+#include "thread_pool.hpp"
+#include "tile_renderer.hpp"
+#include "triangle_mesh.hpp"
 #include "vector3.hpp"
+#include "wavefront_integrator.hpp"
 
 #include "TinyPngOut.hpp" // For writing png files.
 
-using Color = Vector3;
-using Film = std::vector<std::vector<Color>>;
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_WORKER_PROCESSES 1
+#include <spawn.h>
+#include <sys/wait.h>
+extern char **environ;
+#else
+#define HAS_WORKER_PROCESSES 0
+#endif
 
-// Resise the given film to width times height image.
-void resize_film(Film &film, unsigned const width, unsigned height) {
-    film.resize(height);
-    for (auto &row : film) {
-        row.resize(width);
+// Streams 8 bit RGB rows, top row first, into a binary (P6) PPM file.
+class PpmOutput {
+  public:
+    bool open(std::string const &filename, int width, int height) {
+        out.open(filename, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "Unable to open file\n";
+            return false;
+        }
+        out << "P6\n" << width << ' ' << height << "\n255\n";
+        return bool(out);
     }
-}
 
-bool output_ppm_image(std::string const &filename, Film const &image) {
-    std::ofstream out(filename);
-    if (!out.is_open()) {
-        std::cerr << "Unable to open file\n";
-        return false;
+    bool write(std::vector<std::uint8_t> const &rgb) {
+        out.write(reinterpret_cast<char const *>(rgb.data()),
+                  std::streamsize(rgb.size()));
+        return bool(out);
     }
-    out << "P3\n" << image.front().size() << ' ' << image.size() << "\n255\n";
-    for (auto curr = image.rbegin(); curr != image.rend(); ++curr) {
-        for (auto pixel : *curr) {
-            pixel *= 255.0f; // Transform from [0, 1] range to [0, 255]
-            out << static_cast<int>(pixel.r()) << ' '
-                << static_cast<int>(pixel.g()) << ' '
-                << static_cast<int>(pixel.b()) << '\n';
+
+  private:
+    std::ofstream out;
+};
+
+// Streams 8 bit RGB rows, top row first, into a PNG file compressed with the
+// given zlib level, 0 meaning uncompressed.
+class PngOutput {
+  public:
+    bool open(std::string const &filename, int width, int height, int level) {
+        out.open(filename, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "Unable to open file\n";
+            return false;
         }
+        png = std::make_unique<TinyPngOut>(std::uint32_t(width),
+                                           std::uint32_t(height), out, level);
+        return bool(out);
     }
-    return true;
+
+    bool write(std::vector<std::uint8_t> const &rgb) {
+        png->write(rgb.data(), rgb.size() / 3);
+        return bool(out);
+    }
+
+  private:
+    std::ofstream out;
+    std::unique_ptr<TinyPngOut> png;
+};
+
+// Writes snapshots of an image in progress to a PPM file, at most one every
+// interval seconds. A snapshot goes to a temporary file first and replaces the
+// previous one by renaming, so viewers never see a partly written image.
+class SnapshotWriter {
+  public:
+    SnapshotWriter(std::string path, double interval)
+        : path(std::move(path)), interval(interval) {}
+
+    // Whether the interval since the last snapshot has passed.
+    bool due() const {
+        std::chrono::duration<double> const elapsed =
+            std::chrono::steady_clock::now() - last;
+        return elapsed.count() >= interval;
+    }
+
+    // Write a snapshot of 8 bit RGB rows, top row first. Failures are
+    // reported but not fatal, the render goes on.
+    void write(std::vector<std::uint8_t> const &rgb, int width, int height) {
+        last = std::chrono::steady_clock::now();
+        std::string const temporary = path + ".tmp";
+        bool written;
+        {
+            PpmOutput ppm;
+            written = ppm.open(temporary, width, height) && ppm.write(rgb);
+        }
+        // Unlike POSIX, Windows does not rename over an existing file.
+        if (written && std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(path.c_str());
+            written = std::rename(temporary.c_str(), path.c_str()) == 0;
+        }
+        if (!written) {
+            std::cerr << "Unable to write snapshot " << path << '\n';
+        }
+    }
+
+  private:
+    std::string path;
+    double interval;
+    std::chrono::steady_clock::time_point last;
+};
+
+// Scale 8 bit RGB rows of a width times height image up to scaled_width
+// times scaled_height pixels by repeating the nearest pixel.
+void upscale(std::vector<std::uint8_t> const &rgb, int width, int height,
+             int scaled_width, int scaled_height,
+             std::vector<std::uint8_t> &scaled) {
+    scaled.resize(3 * std::size_t(scaled_width) * std::size_t(scaled_height));
+    std::uint8_t *out = scaled.data();
+    for (int y = 0; y != scaled_height; ++y) {
+        std::size_t const row =
+            std::size_t(std::int64_t(y) * height / scaled_height) *
+            std::size_t(width);
+        for (int x = 0; x != scaled_width; ++x) {
+            std::size_t const p =
+                3 * (row + std::size_t(std::int64_t(x) * width / scaled_width));
+            out = std::copy(&rgb[p], &rgb[p] + 3, out);
+        }
+    }
+}
+
+// The scene rendered when no scene file is given.
+SceneDescription simple_scene() {
+    SceneDescription scene;
+    scene.camera = CameraSettings{Vector3(0, 0.5, 1), Vector3(0, 0, -4),
+                                  Vector3(0, 1, 0), 100};
+    StaticScene &world = scene.world;
+    world.add_sphere(Vector3(0.0f, 0.0f, -1.0f), 0.5f,
+                     world.add_material(Lambertian(Vector3(0.8f, 0.2f, 0.2f))));
+    world.add_sphere(Vector3(-1.1f, 0.0f, -1.0f), 0.5f,
+                     world.add_material(Metal(Vector3(0.7f, 0.8f, 0.2f))));
+    world.add_sphere(Vector3(1.1f, 0.0f, -1.0f), 0.5f,
+                     world.add_material(Metal(Vector3(0.7f, 0.7f, 0.9f))));
+    world.add_sphere(Vector3(3.1f, 2.0f, 4.0f), 0.5f,
+                     world.add_material(Lambertian(Vector3(0.9f, 0.1f, 0.2f))));
+    world.add_sphere(Vector3(0.0f, -50.5f, 1.0f), 50.0f,
+                     world.add_material(Lambertian(Vector3(0.8f, 0.9f, 0.1f))));
+    world.add_sphere(Vector3(5.0f, 26.5f, -7.0f), 25.0f,
+                     world.add_material(Metal(Vector3(0.3f, 0.3f, 0.9f))));
+    return scene;
+}
+
+bool ends_with(std::string const &s, char const *suffix) {
+    std::size_t const n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Writes the render statistics so far to std::cerr every interval seconds,
+// one JSON object per line, until destroyed. Mid-render the samples are
+// estimated by the primary rays, over the pixels of one image.
+class StatsStream {
+  public:
+    StatsStream(double interval, std::uint64_t pixels)
+        : start(std::chrono::steady_clock::now()),
+          thread([this, interval, pixels] {
+              std::unique_lock<std::mutex> lock(mutex);
+              auto const period = std::chrono::duration<double>(interval);
+              while (!wake.wait_for(lock, period, [this] { return done; })) {
+                  std::chrono::duration<double> const elapsed =
+                      std::chrono::steady_clock::now() - start;
+                  RenderStats const stats = StatsRegistry::collect();
+                  write_json(std::cerr, stats, pixels, stats.primary_rays,
+                             elapsed.count());
+                  std::cerr << std::endl;
+              }
+          }) {}
+
+    ~StatsStream() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool done = false;
+    std::thread thread;
+};
+
+// Settings which can be changed from the command line.
+struct Options {
+    unsigned threads = ThreadPool::default_worker_count();
+    std::uint64_t seed = 0;
+    int width = 900;
+    int height = 600;
+    int tile_size = 32;
+    // Rows rendered and written out at a time; zero renders the whole image
+    // before writing it.
+    int band_rows = 0;
+    int samples = 50;
+    bool wavefront = false;
+    SampleSequence sequence = SampleSequence::sobol;
+    bool variant_dispatch = false;
+    int png_level = TinyPngOut::isCompressionSupported() ? 6 : 0;
+    // Progressive rendering is used if either noise_threshold or time_budget
+    // is set, or in preview mode.
+    ProgressiveSettings progressive;
+    // Preview mode, if preview_interval is set: a first look at a fraction of
+    // the resolution and one sample per pixel, then progressive passes, with
+    // snapshots of the image so far written at most every preview_interval
+    // seconds.
+    double preview_interval = 0.0;
+    int preview_scale = 4;
+    // Render statistics report, "-" for standard output; needs a build with
+    // TRACEY_STATS.
+    std::string stats_file;
+    double stats_interval = 0.0;
+    // Scene file to render instead of the built-in scene, and a file to save
+    // the scene to (binary if it ends in .bin, else text).
+    std::string scene_file;
+    std::string save_scene_file;
+    // Rendering in parts: render part part_index of part_count and save it
+    // to part_file, or, if workers is set, coordinate that many local worker
+    // processes rendering part_count parts. merge_files are partial images to
+    // merge into the image instead of rendering.
+    PartSplit split = PartSplit::rows;
+    int part_index = -1;
+    int part_count = 0;
+    std::string part_file;
+    int workers = 0;
+    std::vector<std::string> merge_files;
+    // Keyframes of a sequence of frames to render instead of one image.
+    std::string animation_file;
+};
+
+// Name of the image files of an animation frame, without extension.
+std::string frame_name(int frame) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%04d", frame);
+    return name;
+}
+
+// Name of the partial image of part k, unless given with --part-file.
+std::string part_file_name(int k) {
+    return "simple_scene_2.part" + std::to_string(k);
 }
 
-bool output_png_image(std::string const &filename, Film const &image) {
-    std::uint32_t imageWidth = std::uint32_t(image[0].size());
-    std::uint32_t imageHeight = std::uint32_t(image.size());
-    // Convert the Film object to an array of RGB (red, green, blue) pixels with
-    // values between 0 and 255.
-    auto numPixels = 3 * imageWidth * imageHeight;
-    std::vector<std::uint8_t> rawPixels(numPixels);
-    std::size_t currentPixel = 0;
-    for (auto curr = image.rbegin(); curr != image.rend(); ++curr) {
-        for (auto pixel : *curr) {
-            pixel *= 255.0f; // Transform from [0, 1] range to [0, 255]
-            rawPixels[currentPixel++] = std::clamp(int(pixel.r()), 0, 255);
-            rawPixels[currentPixel++] = std::clamp(int(pixel.g()), 0, 255);
-            rawPixels[currentPixel++] = std::clamp(int(pixel.b()), 0, 255);
-        }
-    }
-    std::ofstream out(filename, std::ios::binary);
-    if (!out.is_open()) {
-        std::cerr << "Unable to open file\n";
+// Create a fresh temporary directory for the partial images of worker
+// processes, so that coordinators running side by side never share part
+// files. Returns an empty string on failure.
+std::string make_part_directory() {
+#if HAS_WORKER_PROCESSES
+    std::error_code error;
+    std::string path = (std::filesystem::temp_directory_path(error) /
+                        "tracey-parts-XXXXXX")
+                           .string();
+    if (error || ::mkdtemp(&path[0]) == nullptr) {
+        return {};
+    }
+    return path;
+#else
+    return {};
+#endif
+}
+
+void print_usage(char const *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --threads N    number of render threads (default: all "
+                 "cores)\n"
+              << "  --seed S       seed for the random sampling (default: 0)\n"
+              << "  --scene FILE   render the scene in a text or binary scene "
+                 "file\n"
+              << "  --save-scene FILE  save the scene, in the binary format if "
+                 "FILE ends\n"
+              << "                 in .bin and as text otherwise\n"
+              << "  --size W H     image size in pixels (default: 900 600)\n"
+              << "  --band-rows N  stream the image out in bands of N rows, "
+                 "bounding memory\n"
+              << "                 by the band size (not with --adaptive or\n"
+              << "                 --time-budget)\n"
+              << "  --tile-size N  side of a square render tile in pixels "
+                 "(default: 32)\n"
+              << "  --samples N    samples per pixel, the maximum in adaptive "
+                 "mode (default: 50)\n"
+              << "  --integrator I path (depth first, default) or wavefront "
+                 "(breadth first\n"
+              << "                 in batches)\n"
+              << "  --sampler S    sample points: random, stratified, sobol "
+                 "(default) or\n"
+              << "                 blue-noise\n"
+              << "  --dispatch D   virtual (default) or variant (closed set "
+                 "of types, no\n"
+              << "                 virtual calls)\n"
+              << "  --adaptive E   render progressively, retiring pixels once "
+                 "their relative\n"
+              << "                 noise drops below E (e.g. 0.02)\n"
+              << "  --min-samples N  samples before a pixel may retire "
+                 "(default: 8)\n"
+              << "  --pass-samples N samples per pixel and pass (default: "
+                 "4)\n"
+              << "  --time-budget T  stop progressive rendering after T "
+                 "seconds\n"
+              << "  --preview T    show a first look at reduced resolution "
+                 "and 1 sample per\n"
+              << "                 pixel, then refine it progressively, "
+                 "writing snapshots to\n"
+              << "                 simple_scene_2.preview.ppm at most every T "
+                 "seconds\n"
+              << "  --preview-scale N  first look at 1/N of the resolution "
+                 "(default: 4)\n"
+              << "  --stats FILE   write render statistics as JSON to FILE, "
+                 "- for stdout\n"
+              << "                 (needs a build with TRACEY_STATS)\n"
+              << "  --stats-interval T  also print statistics to stderr every "
+                 "T seconds\n"
+              << "  --png-level N  PNG compression level from 0 (none) to 9 "
+                 "(default: 6 if\n"
+              << "                 built with zlib, else 0)\n"
+              << "  --animation FILE  render the frames of a keyframe file to "
+                 "frame_NNNN.png\n"
+              << "                 and frame_NNNN.ppm\n"
+              << "  --workers N    render in N local worker processes and "
+                 "merge their parts;\n"
+              << "                 --threads is the total over all workers\n"
+              << "  --parts N      number of parts for --workers (default: "
+                 "the number of\n"
+              << "                 workers)\n"
+              << "  --part K N     only render part K of N and save it as a "
+                 "partial image\n"
+              << "  --part-file F  partial image file of --part (default: "
+                 "simple_scene_2.partK)\n"
+              << "  --split S      split parts by rows (default, merges to "
+                 "the image of a\n"
+              << "                 single process) or by samples\n"
+              << "  --merge FILE...  merge partial images into the image "
+                 "instead of rendering\n";
+}
+
+// Parse the command line into options. Returns false on malformed input.
+bool parse_options(int argc, const char *argv[], Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        auto const has_value = [&] { return i + 1 < argc; };
+        if (std::strcmp(argv[i], "--threads") == 0 && has_value()) {
+            options.threads = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--seed") == 0 && has_value()) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--scene") == 0 && has_value()) {
+            options.scene_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--save-scene") == 0 && has_value()) {
+            options.save_scene_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            options.width = std::atoi(argv[++i]);
+            options.height = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--band-rows") == 0 && has_value()) {
+            options.band_rows = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tile-size") == 0 && has_value()) {
+            options.tile_size = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--samples") == 0 && has_value()) {
+            options.samples = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--adaptive") == 0 && has_value()) {
+            options.progressive.noise_threshold =
+                std::strtof(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--min-samples") == 0 && has_value()) {
+            options.progressive.min_samples = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--pass-samples") == 0 &&
+                   has_value()) {
+            options.progressive.samples_per_pass = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--time-budget") == 0 && has_value()) {
+            options.progressive.time_budget = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--preview") == 0 && has_value()) {
+            options.preview_interval = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--preview-scale") == 0 &&
+                   has_value()) {
+            options.preview_scale = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--stats") == 0 && has_value()) {
+            options.stats_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--stats-interval") == 0 &&
+                   has_value()) {
+            options.stats_interval = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--png-level") == 0 && has_value()) {
+            options.png_level = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--integrator") == 0 && has_value()) {
+            ++i;
+            if (std::strcmp(argv[i], "wavefront") == 0) {
+                options.wavefront = true;
+            } else if (std::strcmp(argv[i], "path") == 0) {
+                options.wavefront = false;
+            } else {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "--sampler") == 0 && has_value()) {
+            ++i;
+            if (std::strcmp(argv[i], "random") == 0) {
+                options.sequence = SampleSequence::random;
+            } else if (std::strcmp(argv[i], "stratified") == 0) {
+                options.sequence = SampleSequence::stratified;
+            } else if (std::strcmp(argv[i], "sobol") == 0) {
+                options.sequence = SampleSequence::sobol;
+            } else if (std::strcmp(argv[i], "blue-noise") == 0) {
+                options.sequence = SampleSequence::blue_noise;
+            } else {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "--animation") == 0 && has_value()) {
+            options.animation_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--workers") == 0 && has_value()) {
+            options.workers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--parts") == 0 && has_value()) {
+            options.part_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--part") == 0 && i + 2 < argc) {
+            options.part_index = std::atoi(argv[++i]);
+            options.part_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--part-file") == 0 && has_value()) {
+            options.part_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--split") == 0 && has_value()) {
+            ++i;
+            if (std::strcmp(argv[i], "rows") == 0) {
+                options.split = PartSplit::rows;
+            } else if (std::strcmp(argv[i], "samples") == 0) {
+                options.split = PartSplit::samples;
+            } else {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "--merge") == 0) {
+            while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) {
+                options.merge_files.push_back(argv[++i]);
+            }
+            if (options.merge_files.empty()) {
+                return false;
+            }
+        } else if (std::strcmp(argv[i], "--dispatch") == 0 && has_value()) {
+            ++i;
+            if (std::strcmp(argv[i], "variant") == 0) {
+                options.variant_dispatch = true;
+            } else if (std::strcmp(argv[i], "virtual") == 0) {
+                options.variant_dispatch = false;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    if (!TRACEY_STATS &&
+        (!options.stats_file.empty() || options.stats_interval > 0.0)) {
+        std::cerr << "Statistics need a build with TRACEY_STATS enabled\n";
         return false;
     }
-    TinyPngOut pngout(imageWidth, imageHeight, out);
-    pngout.write(rawPixels.data(), imageWidth * imageHeight);
-    return true;
+    bool const progressive = options.progressive.noise_threshold > 0.0f ||
+                             options.progressive.time_budget > 0.0 ||
+                             options.preview_interval > 0.0;
+    if (options.workers > 0 && options.part_count == 0) {
+        options.part_count = options.workers;
+    }
+    if (options.part_index >= 0 && options.part_file.empty()) {
+        options.part_file = part_file_name(options.part_index);
+    }
+    bool const worker = options.part_index >= 0;
+    bool const coordinator = options.workers > 0;
+    int const modes = int(worker) + int(coordinator) +
+                      int(!options.merge_files.empty()) +
+                      int(!options.animation_file.empty());
+    if (modes > 1 ||
+        ((worker || coordinator) &&
+         (progressive || options.band_rows > 0 ||
+          options.part_index >= options.part_count)) ||
+        (coordinator && (!options.stats_file.empty() ||
+                         options.stats_interval > 0.0 ||
+                         !options.save_scene_file.empty()))) {
+        return false;
+    }
+    return options.threads > 0 && options.width > 0 && options.height > 0 &&
+           options.band_rows >= 0 && !(progressive && options.band_rows > 0) &&
+           options.tile_size > 0 && options.preview_interval >= 0.0 &&
+           options.preview_scale > 0 &&
+           options.samples > 0 && options.progressive.samples_per_pass > 0 &&
+           options.png_level >= 0 && options.png_level <= 9 &&
+           (options.png_level == 0 || TinyPngOut::isCompressionSupported());
 }
 
-/// Maximum reflection depth.
-constexpr int const max_depth = 30;
-
-// Color function, which given a ray and an "world" returns the color which
-// would be seen by the given ray.
-Vector3 scene_color(Ray const &r, Hittable &world, int depth) {
-    HitRecord record;
-    if (world.hit(r, 0.001f, std::numeric_limits<float>::max(), record)) {
-        Ray scattered;
-        Vector3 attenuation;
-        Vector3 target =
-            record.p + record.normal + random_vector_in_unit_sphere();
-        if (depth < max_depth &&
-            record.material->scatter(r, record, attenuation, scattered)) {
-            return attenuation * scene_color(scattered, world, depth + 1);
+// Render options.part_count parts in up to options.workers processes running
+// this program, starting the next part whenever one finishes. The partial
+// images go to part_directory and their names are added to part_files, also
+// when a worker fails.
+bool run_workers(int argc, const char *argv[], Options const &options,
+                 std::string const &part_directory,
+                 std::vector<std::string> &part_files) {
+#if HAS_WORKER_PROCESSES
+    // Pass on the options except those of the coordinator. The threads are
+    // shared among the workers.
+    std::vector<std::string> common;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--workers") == 0 ||
+            std::strcmp(argv[i], "--parts") == 0 ||
+            std::strcmp(argv[i], "--threads") == 0) {
+            ++i;
         } else {
-            return Vector3(0.0f, 0.0f, 0.0f);
+            common.push_back(argv[i]);
+        }
+    }
+    unsigned const threads =
+        std::max(1u, options.threads / unsigned(options.workers));
+    common.insert(common.end(), {"--threads", std::to_string(threads)});
+    int next = 0;
+    int running = 0;
+    bool ok = true;
+    while (running > 0 || (ok && next < options.part_count)) {
+        if (ok && next < options.part_count && running < options.workers) {
+            std::string const part_file =
+                part_directory + "/part" + std::to_string(next);
+            std::vector<std::string> args = common;
+            args.insert(args.end(), {"--part", std::to_string(next),
+                                     std::to_string(options.part_count),
+                                     "--part-file", part_file});
+            std::vector<char *> arg_pointers{const_cast<char *>(argv[0])};
+            for (auto &arg : args) {
+                arg_pointers.push_back(&arg[0]);
+            }
+            arg_pointers.push_back(nullptr);
+            pid_t pid;
+            if (posix_spawnp(&pid, argv[0], nullptr, nullptr,
+                             arg_pointers.data(), environ) != 0) {
+                std::cerr << "Unable to start a worker process\n";
+                ok = false;
+                continue;
+            }
+            part_files.push_back(part_file);
+            ++next;
+            ++running;
+        } else {
+            int status;
+            if (::wait(&status) < 0) {
+                return false;
+            }
+            --running;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::cerr << "A worker process failed\n";
+                ok = false;
+            }
         }
-    } else {
-        // Sky color
-        Vector3 unit_direction = unit_vector(r.direction());
-        float t = 0.5f * (unit_direction.y() + 1.0f);
-        return (1.0f - t) * Vector3(1.0f, 1.0f, 1.0f) +
-               t * Vector3(0.45f, 0.65f, 1.0f);
     }
+    return ok;
+#else
+    (void)argc;
+    (void)argv;
+    (void)options;
+    (void)part_directory;
+    (void)part_files;
+    std::cerr << "Worker processes are not supported on this platform\n";
+    return false;
+#endif
 }
 
-// Gamma correction - a lot of image viewers assume that the output is gamma
-// corrected. For our purposes, just applying sqrt to each of the values is
-// sufficient.
-Vector3 gamma_correction(Vector3 const &color) {
-    return Vector3(std::sqrt(color.r()), std::sqrt(color.g()),
-                   std::sqrt(color.b()));
+// Merge partial images and write the image files.
+bool write_merged_image(std::vector<std::string> const &files,
+                        int png_level) {
+    MergedImage merged;
+    try {
+        merged = merge_partial_images(files);
+    } catch (std::exception const &error) {
+        std::cerr << error.what() << '\n';
+        return false;
+    }
+    std::vector<std::uint8_t> image;
+    merged.film.resolve(image, merged.samples);
+    PpmOutput ppm;
+    PngOutput png;
+    int const nx = merged.film.width();
+    int const ny = merged.film.height();
+    if (!ppm.open("simple_scene_2.ppm", nx, ny) ||
+        !png.open("simple_scene_2.png", nx, ny, png_level) ||
+        !ppm.write(image) || !png.write(image)) {
+        return false;
+    }
+    std::cout << "Merged " << files.size() << " parts with " << merged.samples
+              << " samples per pixel\n";
+    return true;
 }
 
 int main(int argc, const char *argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!options.merge_files.empty()) {
+        return write_merged_image(options.merge_files, options.png_level) ? 0
+                                                                          : 1;
+    }
+    if (options.workers > 0) {
+        auto const start = std::chrono::steady_clock::now();
+        std::string const part_directory = make_part_directory();
+        if (part_directory.empty()) {
+            std::cerr << "Unable to create a directory for the partial "
+                         "images\n";
+            return 1;
+        }
+        std::vector<std::string> part_files;
+        bool const ok =
+            run_workers(argc, argv, options, part_directory, part_files) &&
+            write_merged_image(part_files, options.png_level);
+        for (auto const &file : part_files) {
+            std::remove(file.c_str());
+        }
+        std::error_code error;
+        std::filesystem::remove(part_directory, error);
+        if (!ok) {
+            return 1;
+        }
+        std::chrono::duration<double> const elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << "Rendered " << options.part_count << " parts in "
+                  << options.workers << " worker processes in "
+                  << elapsed.count() << " s\n";
+        return 0;
+    }
     // Image parameters
-    int const nx = 900;
-    int const ny = 600;
-    int const ns = 50;
-    Film output;
-    resize_film(output, nx, ny);
-    // Camera parameters
-    Vector3 origin(0, 0.5, 1);
-    Vector3 lookat(0, 0, -4);
-    Vector3 up(0, 1, 0);
-    Camera cam(origin, lookat, up, 100, float(nx) / float(ny));
-    // Actual scene
-    Composite world;
-    Lambertian sphere_mat_1(Vector3(0.8f, 0.2f, 0.2f));
-    Sphere sphere_small_1(Vector3(0.0f, 0.0f, -1.0f), 0.5f, sphere_mat_1);
-    Metal sphere_mat_2(Vector3(0.7f, 0.8f, 0.2f));
-    Sphere sphere_small_2(Vector3(-1.1f, 0.0f, -1.0f), 0.5f, sphere_mat_2);
-    Metal sphere_mat_3(Vector3(0.7f, 0.7f, 0.9f));
-    Sphere sphere_small_3(Vector3(1.1f, 0.0f, -1.0f), 0.5f, sphere_mat_3);
-    Lambertian sphere_mat_4(Vector3(0.9f, 0.1f, 0.2f));
-    Sphere sphere_small_4(Vector3(3.1f, 2.0f, 4.0f), 0.5f, sphere_mat_4);
-    Lambertian sphere_large_mat_1(Vector3(0.8f, 0.9f, 0.1f));
-    Sphere sphere_large_1(Vector3(0.0f, -50.5f, 1.0f), 50.0f,
-                          sphere_large_mat_1);
-    Metal sphere_large_mat_2(Vector3(0.3f, 0.3f, 0.9f));
-    Sphere sphere_large_2(Vector3(5.0f, 26.5f, -7.0f), 25.0f,
-                          sphere_large_mat_2);
-    world.add_hittable(sphere_small_1);
-    world.add_hittable(sphere_small_2);
-    world.add_hittable(sphere_small_3);
-    world.add_hittable(sphere_small_4);
-    world.add_hittable(sphere_large_1);
-    world.add_hittable(sphere_large_2);
-    // Progress monitoring variables
-    int progressBarTick = 10;
-    int numProgressBarTicks = ny / progressBarTick;
-    std::cout << "Progress:\n|" << std::string(numProgressBarTicks, '=')
-              << "|\n|";
-    // Render loop
-    for (int j = ny - 1; j >= 0; --j) { // Iterate over each row in reverse
-        for (int i = 0; i < nx; ++i) {  //  Iterate over each column
-            // Color into which we will accumulate
-            Color accum(0, 0, 0);
-            for (int s = 0; s != ns;
-                 ++s) { // Take several random samples for the pixel
-                auto u = float(i + random_number()) / float(nx);
-                auto v = float(j + random_number()) / float(ny);
-                // For the given camera ray,
-                accum += scene_color(cam.get_ray(u, v), world, 0);
-            }
-            accum /= float(ns);
-            output[j][i] = gamma_correction(accum);
-        }
-        // Update progress
-        if (j % progressBarTick == 0) {
-            std::cout << '=';
-        }
-    }
-    // Tidy up progress monitoring output
-    std::cout << "|\n";
-    // Write image files
-    if (!output_ppm_image("simple_scene_2.ppm", output)) {
+    int const nx = options.width;
+    int const ny = options.height;
+    int const ns = options.samples;
+    // Resolved 8 bit image, or band of it, top row first
+    std::vector<std::uint8_t> image;
+    // Scene, from a file or the built-in one
+    SceneDescription scene;
+    Animation animation;
+    auto const load_start = std::chrono::steady_clock::now();
+    try {
+        scene = options.scene_file.empty() ? simple_scene()
+                                           : load_scene(options.scene_file);
+        if (!options.animation_file.empty()) {
+            animation = load_animation(options.animation_file,
+                                       scene.world.spheres.size());
+        }
+        if (!options.save_scene_file.empty()) {
+            if (ends_with(options.save_scene_file, ".bin")) {
+                save_scene_binary(options.save_scene_file, scene);
+            } else {
+                save_scene_text(options.save_scene_file, scene);
+            }
+        }
+    } catch (std::exception const &error) {
+        std::cerr << error.what() << '\n';
         return 1;
+    }
+    // Identifies the scene of a partial image, before building reorders it
+    std::uint64_t const scene_id =
+        options.part_index >= 0 ? scene_hash(scene) : 0;
+    std::chrono::duration<double, std::milli> const load_time =
+        std::chrono::steady_clock::now() - load_start;
+    float const aspect = float(nx) / float(ny);
+    Camera cam = scene.camera.camera(aspect);
+    // The scene over the closed set of types is used directly, while virtual
+    // dispatch gets a copy of it as Sphere, Lambertian and Metal objects and
+    // takes over its meshes; only the scene in use builds a hierarchy.
+    StaticScene &static_world = scene.world;
+    std::size_t const spheres = static_world.spheres.size();
+    std::size_t triangles = 0;
+    for (auto const &mesh : static_world.meshes) {
+        triangles += mesh.triangle_count();
+    }
+    ArenaScene world;
+    if (!options.variant_dispatch) {
+        for (auto const &material : static_world.materials) {
+            std::visit(
+                [&](auto const &m) {
+                    world.add_material<std::decay_t<decltype(m)>>(m);
+                },
+                material);
+        }
+        for (auto const &sphere : static_world.spheres) {
+            world.add<Sphere>(sphere.center, sphere.radius,
+                              world.material(sphere.material));
+        }
+        for (std::size_t m = 0; m != static_world.meshes.size(); ++m) {
+            TriangleMesh &mesh = static_world.meshes[m];
+            mesh.material = &world.material(static_world.mesh_materials[m]);
+            mesh.build();
+            world.add<TriangleMesh>(std::move(mesh));
+        }
+        // The copy is all virtual dispatch uses; release the original before
+        // building, so the two never take memory at the same time for long.
+        static_world = StaticScene();
+        world.build();
+    } else {
+        static_world.build();
+    }
+    std::chrono::duration<double, std::milli> const build_time =
+        std::chrono::steady_clock::now() - load_start - load_time;
+    std::cout << "Loaded " << spheres << " spheres and " << triangles
+              << " triangles in " << load_time.count()
+              << " ms, built the scene in " << build_time.count() << " ms\n";
+    ThreadPool pool(options.threads);
+    TileRenderer renderer(pool, options.tile_size);
+    RenderSettings const settings{nx, ny, ns, options.seed, options.sequence};
+    PathIntegrator const path_integrator;
+    WavefrontIntegrator const wavefront_integrator;
+    // Trace samples of a tile of an image with the given settings, with the
+    // chosen integrator and scene
+    auto trace_samples = [&](Tile const &tile, RenderSettings const &image,
+                             SampleRequest const &request,
+                             TileAccumulator &accumulator) {
+        auto trace = [&](auto const &scene) {
+            if (options.wavefront) {
+                wavefront_integrator.render_tile(tile, cam, scene, image,
+                                                 request, accumulator);
+            } else {
+                path_integrator.render_tile(tile, cam, scene, image, request,
+                                            accumulator);
+            }
+        };
+        if (options.variant_dispatch) {
+            trace(static_world);
+        } else {
+            trace(world);
+        }
+    };
+    auto integrate = [&](Tile const &tile, SampleRequest const &request,
+                         TileAccumulator &accumulator) {
+        trace_samples(tile, settings, request, accumulator);
+    };
+    auto const start = std::chrono::steady_clock::now();
+    std::unique_ptr<StatsStream> stats_stream;
+    if (options.stats_interval > 0.0) {
+        stats_stream = std::make_unique<StatsStream>(
+            options.stats_interval, std::uint64_t(nx) * std::uint64_t(ny));
+    }
+    // Sum the samples of request in a tile of an image with the given
+    // settings into film
+    auto render_samples = [&](Tile const &tile, RenderSettings const &image,
+                              SampleRequest const &request, Film &film) {
+        TileAccumulator accumulator;
+        accumulator.reset(std::size_t((tile.x_end - tile.x_begin) *
+                                      (tile.y_end - tile.y_begin)));
+        trace_samples(tile, image, request, accumulator);
+        auto view = film.view(tile);
+        auto sum = accumulator.sum.begin();
+        for (int j = tile.y_begin; j != tile.y_end; ++j) {
+            for (int i = tile.x_begin; i != tile.x_end; ++i) {
+                view.accumulate(i, j, *sum++);
+            }
+        }
+    };
+    // Pixels and samples of the images rendered so far, for the statistics;
+    // progressive rendering takes fewer samples than ns.
+    std::uint64_t const image_pixels = std::uint64_t(nx) * std::uint64_t(ny);
+    std::uint64_t pixels_rendered = 0;
+    std::uint64_t samples_taken = 0;
+    // Render the image into the files name.ppm and name.png
+    Film output;
+    std::vector<std::uint8_t> preview_image;
+    auto render_image = [&](std::string const &name) {
+        PpmOutput ppm;
+        PngOutput png;
+        if (!ppm.open(name + ".ppm", nx, ny) ||
+            !png.open(name + ".png", nx, ny, options.png_level)) {
+            return false;
+        }
+        bool const preview = options.preview_interval > 0.0;
+        if (preview || options.progressive.noise_threshold > 0.0f ||
+            options.progressive.time_budget > 0.0) {
+            auto const image_start = std::chrono::steady_clock::now();
+            SnapshotWriter snapshot(name + ".preview.ppm",
+                                    options.preview_interval);
+            ProgressiveSettings progressive_settings = options.progressive;
+            if (preview) {
+                // A first look at a fraction of the resolution, scaled up
+                RenderSettings const first_look{
+                    std::max(1, nx / options.preview_scale),
+                    std::max(1, ny / options.preview_scale), 1, options.seed,
+                    options.sequence};
+                Film film(first_look.width, first_look.height);
+                renderer.render(first_look.width, first_look.height,
+                                [&](Tile const &tile, std::size_t) {
+                                    render_samples(tile, first_look,
+                                                   SampleRequest{0, 1}, film);
+                                });
+                film.resolve(preview_image, 1);
+                upscale(preview_image, first_look.width, first_look.height, nx,
+                        ny, image);
+                snapshot.write(image, nx, ny);
+                std::chrono::duration<double, std::milli> const elapsed =
+                    std::chrono::steady_clock::now() - image_start;
+                std::cout << "First look after " << elapsed.count() << " ms\n";
+                // Then passes from one sample per pixel up
+                progressive_settings.max_samples_per_pass =
+                    progressive_settings.samples_per_pass;
+                progressive_settings.samples_per_pass = 1;
+            }
+            ProgressiveRenderer progressive(renderer, settings,
+                                            progressive_settings);
+            progressive.render(integrate, [&](ProgressiveRenderer const &r) {
+                std::cout << "Pass " << r.passes() << ": " << r.active_pixels()
+                          << " pixels still active\n";
+                if (preview && !r.finished() && snapshot.due()) {
+                    r.resolve(image);
+                    snapshot.write(image, nx, ny);
+                }
+            });
+            progressive.resolve(image);
+            if (preview) {
+                snapshot.write(image, nx, ny);
+            }
+            double const budget = double(image_pixels) * double(ns);
+            std::cout << "Took " << progressive.total_samples() << " samples, "
+                      << 100.0 * double(progressive.total_samples()) / budget
+                      << "% of " << ns << " per pixel\n";
+            if (!ppm.write(image) || !png.write(image)) {
+                return false;
+            }
+            pixels_rendered += image_pixels;
+            samples_taken += progressive.total_samples();
+            return true;
+        }
+        // Render in bands of rows from the top down, writing out each band
+        // once it is done; without streaming the whole image is one band.
+        int const band_rows = options.band_rows > 0 ? options.band_rows : ny;
+        // Progress monitoring variables
+        int progressBarTick = 10;
+        int numProgressBarTicks = ny / progressBarTick;
+        int ticksShown = 0;
+        std::cout << "Progress:\n|" << std::string(numProgressBarTicks, '=')
+                  << "|\n|";
+        // Render loop
+        auto render_tile = [&](Tile const &tile, std::size_t) {
+            render_samples(tile, settings, SampleRequest{0, ns}, output);
+        };
+        int rows_done = 0;
+        auto update_progress = [&](std::size_t done, std::size_t total) {
+            int const band_height = output.height();
+            int const ticks = int(
+                (std::int64_t(rows_done) * std::int64_t(total) +
+                 std::int64_t(done) * band_height) *
+                numProgressBarTicks / (std::int64_t(ny) * std::int64_t(total)));
+            for (; ticksShown < ticks; ++ticksShown) {
+                std::cout << '=' << std::flush;
+            }
+        };
+        for (Tile const &band : split_into_bands(nx, ny, band_rows)) {
+            output.resize(band);
+            renderer.render_region(band, render_tile, update_progress);
+            rows_done += output.height();
+            output.resolve(image, ns);
+            if (!ppm.write(image) || !png.write(image)) {
+                return false;
+            }
+        }
+        // Tidy up progress monitoring output
+        std::cout << "|\n";
+        pixels_rendered += image_pixels;
+        samples_taken += image_pixels * std::uint64_t(ns);
+        return true;
     };
-    if (!output_png_image("simple_scene_2.png", output)) {
+    if (options.part_index >= 0) {
+        // Render one part of the image and save its sums for merging
+        PartialImage partial;
+        partial.width = nx;
+        partial.height = ny;
+        partial.seed = options.seed;
+        partial.samples = ns;
+        partial.sampler = int(options.sequence);
+        partial.integrator = options.wavefront ? 1 : 0;
+        partial.max_depth = max_depth;
+        partial.scene = scene_id;
+        partial.part = render_part(nx, ny, ns, options.split,
+                                   options.part_index, options.part_count);
+        partial.film.resize(partial.part.region);
+        SampleRequest const request{partial.part.sample_begin,
+                                    partial.part.sample_end};
+        renderer.render_region(
+            partial.part.region,
+            [&](Tile const &tile, std::size_t) {
+                render_samples(tile, settings, request, partial.film);
+            },
+            [](std::size_t, std::size_t) {});
+        Tile const &region = partial.part.region;
+        pixels_rendered = std::uint64_t(region.x_end - region.x_begin) *
+                          std::uint64_t(region.y_end - region.y_begin);
+        samples_taken = pixels_rendered * std::uint64_t(request.end -
+                                                        request.begin);
+        try {
+            save_partial_image(options.part_file, partial);
+        } catch (std::exception const &error) {
+            std::cerr << error.what() << '\n';
+            return 1;
+        }
+        std::cout << "Rendered part " << options.part_index << " of "
+                  << options.part_count << " to " << options.part_file
+                  << '\n';
+    } else if (!options.animation_file.empty()) {
+        // Render the frames with the scene, thread pool and buffers set up
+        // once, refitting the hierarchy to the moving spheres
+        for (int frame = 0; frame != animation.frames; ++frame) {
+            auto const frame_start = std::chrono::steady_clock::now();
+            cam = animation.camera(frame, scene.camera).camera(aspect);
+            for (auto const &track : animation.sphere_tracks) {
+                SphereKey const key = animation.sphere(track, frame);
+                if (options.variant_dispatch) {
+                    StaticSphere &sphere = static_world.sphere(track.sphere);
+                    sphere.center = key.center;
+                    sphere.radius = key.radius;
+                } else {
+                    auto &sphere =
+                        static_cast<Sphere &>(world.hittable(track.sphere));
+                    sphere.center = key.center;
+                    sphere.radius = key.radius;
+                }
+            }
+            if (!animation.sphere_tracks.empty()) {
+                if (options.variant_dispatch) {
+                    static_world.refit();
+                } else {
+                    world.refit();
+                }
+            }
+            std::uint64_t const samples_before = samples_taken;
+            if (!render_image(frame_name(frame))) {
+                return 1;
+            }
+            std::chrono::duration<double, std::milli> const frame_time =
+                std::chrono::steady_clock::now() - frame_start;
+            std::cout << "Frame " << frame << " of " << animation.frames
+                      << " took " << frame_time.count() << " ms, "
+                      << double(samples_taken - samples_before) /
+                             double(image_pixels)
+                      << " samples per pixel\n";
+        }
+    } else if (!render_image("simple_scene_2")) {
         return 1;
     }
+    stats_stream.reset();
+    if (!options.stats_file.empty()) {
+        std::chrono::duration<double> const elapsed =
+            std::chrono::steady_clock::now() - start;
+        RenderStats const stats = StatsRegistry::collect();
+        if (options.stats_file == "-") {
+            write_json(std::cout, stats, pixels_rendered, samples_taken,
+                       elapsed.count());
+            std::cout << '\n';
+        } else {
+            std::ofstream out(options.stats_file);
+            write_json(out, stats, pixels_rendered, samples_taken,
+                       elapsed.count());
+            out << '\n';
+            if (!out) {
+                std::cerr << "Unable to write " << options.stats_file << '\n';
+                return 1;
+            }
+        }
+    }
     return 0;
 }
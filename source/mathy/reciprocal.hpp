@@ -0,0 +1,29 @@
+#pragma once
+
+// Reciprocal square root shared by both Vector3 backends.
+
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/// Approximate 1 / sqrt(x): the hardware estimate refined by Newton-Raphson
+/// steps to within a few ulp on x86 (SSE) and 64 bit ARM (NEON), and exact
+/// elsewhere. Infinite for zero and NaN for negative x.
+inline float rsqrt(float x) {
+#if defined(__SSE__)
+    float const y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return y * (1.5f - 0.5f * x * y * y);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    // The NEON estimate has 8 bits, so it takes two steps.
+    float y = vrsqrtes_f32(x);
+    y *= vrsqrtss_f32(x * y, y);
+    y *= vrsqrtss_f32(x * y, y);
+    return y;
+#else
+    return 1.0f / std::sqrt(x);
+#endif
+}
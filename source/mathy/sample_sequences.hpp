@@ -0,0 +1,187 @@
+#pragma once
+
+// Building blocks of the low discrepancy sample sequences of Sampler. The
+// sequences are generated point by point from an index and a scramble seed,
+// without tables, so that every pixel sample can be drawn independently:
+//
+// - Sobol' points in two dimensions, Owen scrambled and shuffled with the
+//   hash based nested uniform scrambling of Burley, "Practical Hash-based
+//   Owen Scrambling" (JCGT 2020). Higher dimensions are padded with further
+//   independently shuffled pairs.
+// - Correlated multi-jittered points of Kensler, "Correlated Multi-Jittered
+//   Sampling" (Pixar technical memo 13-01), stratified in two dimensions and
+//   in each of them alone, for a known number of points.
+// - Morton (Z) order of pixels, with the children of every quadtree node
+//   shuffled, which maps neighbouring pixels to neighbouring blocks of one
+//   shared sequence as in Ahmed and Wonka, "Screen-Space Blue-Noise Diffusion
+//   of Monte Carlo Sampling Error via Hierarchical Ordering of Pixels"
+//   (SIGGRAPH Asia 2020).
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace sample_sequences {
+
+/// Well mixed 32 bit hash (lowbias32 of Chris Wellons).
+inline std::uint32_t hash(std::uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/// Hash of a seed and a value, e.g. a dimension.
+inline std::uint32_t hash(std::uint32_t seed, std::uint32_t value) {
+    return hash(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline std::uint32_t reverse_bits(std::uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/// Laine and Karras' permutation: an Owen scramble from the least
+/// significant bit up.
+inline std::uint32_t laine_karras_permutation(std::uint32_t x,
+                                              std::uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+/// Owen scramble the bits of x, most significant first, as a random
+/// permutation of the binary tree of its digits selected by seed. Aligned
+/// blocks of 2^k values map to aligned blocks of 2^k values.
+inline std::uint32_t nested_uniform_scramble(std::uint32_t x,
+                                             std::uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+/// Dimensions 0 and 1 of Sobol' point index, as 32 bit fixed point
+/// fractions, from the reversed bits of the index.
+inline std::array<std::uint32_t, 2> sobol_reversed(std::uint32_t reversed) {
+    std::uint32_t const x = reversed;
+    // The generator matrix of dimension 1 is the Pascal matrix mod 2, which
+    // takes five shift and xor steps on the reversed bits.
+    std::uint32_t y = x;
+    y ^= y << 16;
+    y ^= (y & 0x00ff00ffu) << 8;
+    y ^= (y & 0x0f0f0f0fu) << 4;
+    y ^= (y & 0x33333333u) << 2;
+    y ^= (y & 0x55555555u) << 1;
+    return {x, y};
+}
+
+/// Dimensions 0 and 1 of point index of a Sobol' sequence shuffled and Owen
+/// scrambled by seed, as 32 bit fixed point fractions.
+inline std::array<std::uint32_t, 2> scrambled_sobol(std::uint32_t index,
+                                                    std::uint32_t seed) {
+    // Shuffling the index ends with the reversal Sobol' points start with.
+    auto const [x, y] = sobol_reversed(
+        laine_karras_permutation(reverse_bits(index), seed));
+    return {nested_uniform_scramble(x, hash(seed, 1)),
+            nested_uniform_scramble(y, hash(seed, 2))};
+}
+
+/// Pseudo random permutation of [0, size) selected by pattern; the value
+/// index maps to.
+inline std::uint32_t permute(std::uint32_t index, std::uint32_t size,
+                             std::uint32_t pattern) {
+    std::uint32_t w = size - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    // Cycle walk a hash on [0, w] until it lands in [0, size).
+    do {
+        index ^= pattern;
+        index *= 0xe170893du;
+        index ^= pattern >> 16;
+        index ^= (index & w) >> 4;
+        index ^= pattern >> 8;
+        index *= 0x0929eb3fu;
+        index ^= pattern >> 23;
+        index ^= (index & w) >> 1;
+        index *= 1 | pattern >> 27;
+        index *= 0x6935fa69u;
+        index ^= (index & w) >> 11;
+        index *= 0x74dcb303u;
+        index ^= (index & w) >> 2;
+        index *= 0x9e501cc3u;
+        index ^= (index & w) >> 2;
+        index *= 0xc860a3dfu;
+        index &= w;
+        index ^= index >> 5;
+    } while (index >= size);
+    return (index + pattern) % size;
+}
+
+/// Uniform float in [0, 1) hashed from index and pattern.
+inline float hashed_float(std::uint32_t index, std::uint32_t pattern) {
+    return float(hash(index, pattern) >> 8) * 0x1.0p-24f;
+}
+
+/// Point index of count correlated multi-jittered points in [0, 1)^2
+/// selected by pattern. index must be less than count.
+inline std::array<float, 2> multi_jittered(std::uint32_t index,
+                                           std::uint32_t count,
+                                           std::uint32_t pattern) {
+    // Kensler's mapping for arbitrary counts: an m by n grid of cells with
+    // m n >= count, of which only count are filled. Every point has its own
+    // column of m in x, its own sub-column within it, and its own of count
+    // rows in y, so that both dimensions stay evenly stratified when count
+    // is not m n.
+    auto const m = std::max(1u, std::uint32_t(std::sqrt(float(count))));
+    std::uint32_t const n = (count + m - 1) / m;
+    std::uint32_t const s = permute(index, count, pattern * 0x51633e2du);
+    std::uint32_t const sx = permute(s % m, m, pattern * 0x68bc21ebu);
+    std::uint32_t const sy = permute(s / m, n, pattern * 0x02e5be93u);
+    float const jx = hashed_float(s, pattern * 0x967a889bu);
+    float const jy = hashed_float(s, pattern * 0x368cc8b7u);
+    float const x = (float(sx) + (float(sy) + jx) / float(n)) / float(m);
+    float const y = (float(s) + jy) / float(count);
+    // Rounding may reach 1.
+    return {std::min(x, 0x1.fffffep-1f), std::min(y, 0x1.fffffep-1f)};
+}
+
+/// Spread the lower 16 bits of x to the even bits.
+inline std::uint32_t spread_bits(std::uint32_t x) {
+    x &= 0x0000ffffu;
+    x = (x | (x << 8)) & 0x00ff00ffu;
+    x = (x | (x << 4)) & 0x0f0f0f0fu;
+    x = (x | (x << 2)) & 0x33333333u;
+    x = (x | (x << 1)) & 0x55555555u;
+    return x;
+}
+
+/// Index of pixel (x, y) in a Morton order of a 2^levels square, at most
+/// 2^16, in which the four children of every quadtree node are visited in an
+/// order shuffled by seed.
+inline std::uint32_t shuffled_morton_index(std::uint32_t x, std::uint32_t y,
+                                           int levels, std::uint32_t seed) {
+    std::uint32_t const morton = spread_bits(x) | (spread_bits(y) << 1);
+    std::uint32_t index = 0;
+    for (int level = 0; level != levels; ++level) {
+        // The node is identified by its level and the Morton index of its
+        // parent, so the levels are shuffled independently of each other.
+        std::uint32_t const parent = level + 1 < 16 ? morton >> (2 * level + 2)
+                                                    : 0;
+        std::uint32_t const shuffle =
+            hash(hash(seed, std::uint32_t(level)), parent) & 3;
+        index |= (((morton >> (2 * level)) & 3) ^ shuffle) << (2 * level);
+    }
+    return index;
+}
+
+} // namespace sample_sequences
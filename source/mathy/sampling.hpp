@@ -1,25 +1,151 @@
 #pragma once
 
-#include <random>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 
+#include "constants.hpp"
+#include "sample_sequences.hpp"
 #include "vector3.hpp"
 
-inline double random_number()
-{
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_real_distribution<> dis(0.0, 1.0);
-    return dis(gen);
+/// Where a Sampler takes its numbers from.
+enum class SampleSequence : std::uint8_t {
+    /// Independent random numbers.
+    random,
+    /// Correlated multi-jittered points, stratified per pair of dimensions.
+    stratified,
+    /// Owen scrambled Sobol' points.
+    sobol,
+    /// Owen scrambled Sobol' points shared by all pixels, neighbouring pixels
+    /// taking neighbouring blocks of points, which spreads the error of the
+    /// image as blue noise.
+    blue_noise
+};
+
+/// Source of uniform random numbers for Monte Carlo sampling, built on the
+/// PCG32 (XSH-RR) generator. A sampler is cheap to construct and carries 40
+/// bytes of state, 16 for the generator and 24 for the position in a low
+/// discrepancy sequence, so the renderer creates one per pixel sample instead
+/// of sharing a generator between threads. Equal seed and stream always yield
+/// the same sequence.
+///
+/// A sampler may instead draw the numbers of next_float() as the successive
+/// dimensions of one point of a low discrepancy sequence, see use_sequence().
+/// The dimensions are taken in pairs, each pair scrambled independently, so
+/// that 2D decisions like directions drawn with next_2d() are stratified.
+class Sampler {
+  public:
+    explicit Sampler(std::uint64_t seed = 0, std::uint64_t stream = 0)
+        : state(0), increment((stream << 1u) | 1u) {
+        next_uint();
+        state += seed;
+        next_uint();
+    }
+
+    /// Draw next_float() from point index of sequence. count is the number
+    /// of points of the pattern for stratified sequences, and scramble
+    /// selects the pattern: points of different patterns are uncorrelated.
+    void use_sequence(SampleSequence sequence, std::uint32_t index,
+                      std::uint32_t count, std::uint32_t scramble) {
+        this->sequence = sequence;
+        this->index = index;
+        this->count = std::max(count, index + 1);
+        this->scramble = scramble;
+        dimension = 0;
+    }
+
+    /// Uniformly distributed 32 bit integer.
+    std::uint32_t next_uint() {
+        std::uint64_t const old = state;
+        state = old * 6364136223846793005ull + increment;
+        auto const xorshifted = std::uint32_t(((old >> 18u) ^ old) >> 27u);
+        auto const rot = std::uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+    }
+
+    /// Uniformly distributed float in [0, 1).
+    float next_float() {
+        if (sequence == SampleSequence::random) {
+            return to_float(next_uint());
+        }
+        // Both dimensions of a pair are computed together.
+        if (dimension++ & 1) {
+            return pair_second;
+        }
+        auto const [first, second] = sequence_pair(dimension >> 1);
+        pair_second = second;
+        return first;
+    }
+
+    /// Two uniformly distributed floats in [0, 1), from one pair of
+    /// dimensions of a sequence.
+    std::array<float, 2> next_2d() {
+        dimension += dimension & 1;
+        float const u = next_float();
+        float const v = next_float();
+        return {u, v};
+    }
+
+  private:
+    static float to_float(std::uint32_t bits) {
+        // The top 24 bits fill the mantissa exactly, so the result never
+        // rounds up to 1.
+        return float(bits >> 8) * 0x1.0p-24f;
+    }
+
+    std::array<float, 2> sequence_pair(std::uint32_t pair) const {
+        using namespace sample_sequences;
+        std::uint32_t const pattern = hash(scramble, pair);
+        if (sequence == SampleSequence::stratified) {
+            return multi_jittered(index, count, pattern);
+        }
+        auto const [x, y] = scrambled_sobol(index, pattern);
+        return {to_float(x), to_float(y)};
+    }
+
+    std::uint64_t state;
+    std::uint64_t increment;
+    SampleSequence sequence = SampleSequence::random;
+    std::uint32_t index = 0;
+    std::uint32_t count = 1;
+    std::uint32_t scramble = 0;
+    std::uint32_t dimension = 0;
+    float pair_second = 0.0f;
+};
+
+static_assert(sizeof(Sampler) <= 40, "Sampler outgrew its documented size");
+
+/// Derive a well mixed seed from a base seed and a stream identifier (e.g. a
+/// sample index), using the SplitMix64 finaliser.
+inline std::uint64_t mix_seed(std::uint64_t seed, std::uint64_t stream) {
+    std::uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline Vector3 random_vector(Sampler &sampler) {
+    float const x = sampler.next_float();
+    float const y = sampler.next_float();
+    float const z = sampler.next_float();
+    return Vector3(x, y, z);
 }
 
-inline Vector3 random_vector() {
-    return Vector3(float(random_number()), float(random_number()), float(random_number()));
+/// Uniformly distributed direction, drawn directly from one 2D sample.
+inline Vector3 random_unit_vector(Sampler &sampler) {
+    auto const [u, v] = sampler.next_2d();
+    float const z = 1.0f - 2.0f * u;
+    float const r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    float const phi = 2.0f * float(pi) * v;
+    return Vector3(r * std::cos(phi), r * std::sin(phi), z);
 }
 
-inline Vector3 random_vector_in_unit_sphere() {
-    Vector3 p;
-    do {
-        p = 2.0f * random_vector() - Vector3(1,1,1);
-    } while (dot(p,p) >= 1.0f);
-    return p;
+/// Uniformly distributed point in the unit ball. Drawn directly rather than
+/// by rejection, so that it always takes the same three dimensions of a
+/// sequence.
+inline Vector3 random_vector_in_unit_sphere(Sampler &sampler) {
+    Vector3 const direction = random_unit_vector(sampler);
+    // The volume within radius r grows with r^3.
+    return std::cbrt(sampler.next_float()) * direction;
 }
@@ -1,8 +1,27 @@
 #pragma once
 
+// Vector3 is a plain struct of three floats, or, if MATHY_SIMD is defined to 1
+// (the CMake option of the same name), SimdVector3 of vector3_simd.hpp with
+// the same interface. Both come with rcp(), multiply_add() and, from
+// reciprocal.hpp, rsqrt(); the scalar Vector3 keeps normalising exactly.
+
 #include <cmath>
 #include <iostream>
 
+#include "reciprocal.hpp"
+
+#ifndef MATHY_SIMD
+#define MATHY_SIMD 0
+#endif
+
+#if MATHY_SIMD
+
+#include "vector3_simd.hpp"
+
+using Vector3 = SimdVector3;
+
+#else
+
 struct Vector3  {
     Vector3() = default;
     Vector3(float e0, float e1, float e2) : e{e0, e1, e2} { }
@@ -131,3 +150,20 @@ inline Vector3& Vector3::operator/=(const float t) {
 inline Vector3 unit_vector(const Vector3& v) {
     return v / v.length();
 }
+
+/// Component wise reciprocal.
+inline Vector3 rcp(const Vector3 &v) {
+    return Vector3(1.0f / v.e[0], 1.0f / v.e[1], 1.0f / v.e[2]);
+}
+
+/// a * b + c, component wise.
+inline Vector3 multiply_add(const Vector3 &a, const Vector3 &b,
+                            const Vector3 &c) {
+    return a * b + c;
+}
+
+inline Vector3 multiply_add(float t, const Vector3 &a, const Vector3 &c) {
+    return t * a + c;
+}
+
+#endif
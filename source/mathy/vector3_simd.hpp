@@ -0,0 +1,188 @@
+#pragma once
+
+// Vector3 with its components in one 16 byte SIMD register: x, y and z plus
+// a padding lane w, built on the vector extensions of GCC and Clang, which
+// compile to SSE on x86 and NEON on ARM without target specific intrinsics.
+// It has the interface of the scalar Vector3 and replaces it when mathy is
+// configured with MATHY_SIMD (see vector3.hpp).
+//
+// The w lane is zero after construction but otherwise unspecified, e.g. NaN
+// after dividing by a vector; no operation reads it. Divisions by a scalar
+// multiply by one reciprocal instead of dividing every component, and
+// normalisation uses the approximate rsqrt(), so results may differ
+// from the scalar Vector3 in the last bits.
+
+#if !defined(__GNUC__)
+#error "SimdVector3 needs the vector extensions of GCC or Clang"
+#endif
+
+#include <cmath>
+#include <iostream>
+
+#include "reciprocal.hpp"
+
+struct alignas(16) SimdVector3 {
+    using Lanes [[gnu::vector_size(16)]] = float;
+
+    SimdVector3() = default;
+    SimdVector3(float e0, float e1, float e2) : e{e0, e1, e2, 0.0f} {}
+    explicit SimdVector3(Lanes lanes) : e(lanes) {}
+
+    float x() const { return e[0]; }
+    float y() const { return e[1]; }
+    float z() const { return e[2]; }
+    float r() const { return e[0]; }
+    float g() const { return e[1]; }
+    float b() const { return e[2]; }
+
+    SimdVector3 const &operator+() const { return *this; }
+    SimdVector3 operator-() const { return SimdVector3(-e); }
+    float operator[](int i) const { return e[i]; }
+
+    /// Stands in for a float & to a lane, which the vector extensions do not
+    /// provide; every access goes through the subscript of e.
+    class LaneReference {
+      public:
+        LaneReference(Lanes &e, int i) : e(e), i(i) {}
+        operator float() const { return e[i]; }
+        LaneReference &operator=(float f) {
+            e[i] = f;
+            return *this;
+        }
+        LaneReference &operator=(LaneReference const &other) {
+            return *this = float(other);
+        }
+        LaneReference &operator+=(float f) { return *this = e[i] + f; }
+        LaneReference &operator-=(float f) { return *this = e[i] - f; }
+        LaneReference &operator*=(float f) { return *this = e[i] * f; }
+        LaneReference &operator/=(float f) { return *this = e[i] / f; }
+
+      private:
+        Lanes &e;
+        int i;
+    };
+    LaneReference operator[](int i) { return LaneReference(e, i); }
+
+    SimdVector3 &operator+=(SimdVector3 const &v) {
+        e += v.e;
+        return *this;
+    }
+    SimdVector3 &operator-=(SimdVector3 const &v) {
+        e -= v.e;
+        return *this;
+    }
+    SimdVector3 &operator*=(SimdVector3 const &v) {
+        e *= v.e;
+        return *this;
+    }
+    SimdVector3 &operator/=(SimdVector3 const &v) {
+        e /= v.e;
+        return *this;
+    }
+    SimdVector3 &operator*=(float t) {
+        e *= t;
+        return *this;
+    }
+    SimdVector3 &operator/=(float t) {
+        e *= 1.0f / t;
+        return *this;
+    }
+
+    float squared_length() const {
+        Lanes const p = e * e;
+        return p[0] + p[1] + p[2];
+    }
+    float length() const { return std::sqrt(squared_length()); }
+    void make_unit_vector() { e *= rsqrt(squared_length()); }
+
+    Lanes e{0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+inline std::istream &operator>>(std::istream &is, SimdVector3 &t) {
+    float x, y, z;
+    if (is >> x >> y >> z) {
+        t = SimdVector3(x, y, z);
+    }
+    return is;
+}
+
+inline std::ostream &operator<<(std::ostream &os, SimdVector3 const &t) {
+    os << t.x() << " " << t.y() << " " << t.z();
+    return os;
+}
+
+inline SimdVector3 operator+(SimdVector3 const &v1, SimdVector3 const &v2) {
+    return SimdVector3(v1.e + v2.e);
+}
+
+inline SimdVector3 operator-(SimdVector3 const &v1, SimdVector3 const &v2) {
+    return SimdVector3(v1.e - v2.e);
+}
+
+inline SimdVector3 operator*(SimdVector3 const &v1, SimdVector3 const &v2) {
+    return SimdVector3(v1.e * v2.e);
+}
+
+inline SimdVector3 operator/(SimdVector3 const &v1, SimdVector3 const &v2) {
+    return SimdVector3(v1.e / v2.e);
+}
+
+inline SimdVector3 operator*(float t, SimdVector3 const &v) {
+    return SimdVector3(t * v.e);
+}
+
+inline SimdVector3 operator*(SimdVector3 const &v, float t) {
+    return SimdVector3(v.e * t);
+}
+
+inline SimdVector3 operator/(SimdVector3 const &v, float t) {
+    return SimdVector3(v.e * (1.0f / t));
+}
+
+inline float dot(SimdVector3 const &v1, SimdVector3 const &v2) {
+    SimdVector3::Lanes const p = v1.e * v2.e;
+    return p[0] + p[1] + p[2];
+}
+
+namespace simd_vector3_detail {
+
+/// The lanes of v in the order (a, b, c, d).
+template <int a, int b, int c, int d>
+SimdVector3::Lanes shuffle(SimdVector3::Lanes v) {
+#if defined(__clang__)
+    return __builtin_shufflevector(v, v, a, b, c, d);
+#else
+    using Indices [[gnu::vector_size(16)]] = int;
+    return __builtin_shuffle(v, Indices{a, b, c, d});
+#endif
+}
+
+} // namespace simd_vector3_detail
+
+inline SimdVector3 cross(SimdVector3 const &v1, SimdVector3 const &v2) {
+    using simd_vector3_detail::shuffle;
+    // (y1 z2 - z1 y2, z1 x2 - x1 z2, x1 y2 - y1 x2)
+    return SimdVector3(shuffle<1, 2, 0, 3>(v1.e) * shuffle<2, 0, 1, 3>(v2.e) -
+                       shuffle<2, 0, 1, 3>(v1.e) * shuffle<1, 2, 0, 3>(v2.e));
+}
+
+inline SimdVector3 unit_vector(SimdVector3 const &v) {
+    return v * rsqrt(dot(v, v));
+}
+
+/// Component wise reciprocal.
+inline SimdVector3 rcp(SimdVector3 const &v) {
+    return SimdVector3(1.0f / v.e);
+}
+
+/// a * b + c, component wise; one fused multiply-add per lane where the
+/// target has them and contraction is enabled.
+inline SimdVector3 multiply_add(SimdVector3 const &a, SimdVector3 const &b,
+                                SimdVector3 const &c) {
+    return SimdVector3(a.e * b.e + c.e);
+}
+
+inline SimdVector3 multiply_add(float t, SimdVector3 const &a,
+                                SimdVector3 const &c) {
+    return SimdVector3(t * a.e + c.e);
+}
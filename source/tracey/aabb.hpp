@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "ray.hpp"
+#include "vector3.hpp"
+
+/// Axis aligned bounding box. A default constructed box is empty, so it can be
+/// grown with expand() from nothing.
+struct Aabb {
+    Aabb()
+        : minimum(std::numeric_limits<float>::max(),
+                  std::numeric_limits<float>::max(),
+                  std::numeric_limits<float>::max()),
+          maximum(-std::numeric_limits<float>::max(),
+                  -std::numeric_limits<float>::max(),
+                  -std::numeric_limits<float>::max()) {}
+    Aabb(Vector3 const &min, Vector3 const &max) : minimum(min), maximum(max) {}
+
+    bool empty() const {
+        return minimum.x() > maximum.x() || minimum.y() > maximum.y() ||
+               minimum.z() > maximum.z();
+    }
+
+    Vector3 centroid() const { return 0.5f * (minimum + maximum); }
+
+    /// Surface area, the quantity used by the surface area heuristic.
+    float surface_area() const {
+        if (empty()) {
+            return 0.0f;
+        }
+        Vector3 const d = maximum - minimum;
+        return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    // With MATHY_SIMD a lane of Vector3 is a proxy, hence std::min<float>.
+    void expand(Vector3 const &p) {
+        for (int a = 0; a != 3; ++a) {
+            minimum[a] = std::min<float>(minimum[a], p[a]);
+            maximum[a] = std::max<float>(maximum[a], p[a]);
+        }
+    }
+
+    void expand(Aabb const &box) {
+        for (int a = 0; a != 3; ++a) {
+            minimum[a] = std::min<float>(minimum[a], box.minimum[a]);
+            maximum[a] = std::max<float>(maximum[a], box.maximum[a]);
+        }
+    }
+
+    /// Slab test against a ray given by its origin and the reciprocal of its
+    /// direction. NaNs from 0 * inf are discarded by the comparison order.
+    bool hit(Vector3 const &origin, Vector3 const &inv_direction, float t_min,
+             float t_max) const {
+        for (int a = 0; a != 3; ++a) {
+            float t0 = (minimum[a] - origin[a]) * inv_direction[a];
+            float t1 = (maximum[a] - origin[a]) * inv_direction[a];
+            if (inv_direction[a] < 0.0f) {
+                std::swap(t0, t1);
+            }
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Vector3 minimum;
+    Vector3 maximum;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+/// Allocator handing out storage aligned to Alignment bytes, e.g. to start
+/// large buffers on a cache line.
+template <typename T, std::size_t Alignment> struct AlignedAllocator {
+    static_assert(Alignment >= alignof(T), "Alignment too small for T");
+
+    using value_type = T;
+    template <typename U> struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(AlignedAllocator<U, Alignment> const &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(
+            ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T *p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(AlignedAllocator<U, Alignment> const &) const noexcept {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(AlignedAllocator<U, Alignment> const &) const noexcept {
+        return false;
+    }
+};
+
+/// Size of a cache line on the platforms we care about.
+constexpr std::size_t const cache_line_size = 64;
@@ -0,0 +1,176 @@
+#pragma once
+
+// Animations: keyframes of the camera and of spheres of a scene, in a text
+// file with one statement per line, '#' starting a comment:
+//
+//   frames <count>
+//   camera <frame> <lookfrom x y z> <lookat x y z> <up x y z> <vertical fov>
+//   sphere <frame> <sphere index> <center x y z> <radius>
+//
+// Frames are numbered from 0 and sphere indices count the spheres in the
+// order of the scene file. Between keyframes values are interpolated
+// linearly; before the first and after the last keyframe they are held. The
+// camera of the scene file is used if there are no camera keyframes.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_input.hpp"
+#include "scene_file.hpp"
+#include "vector3.hpp"
+
+struct CameraKey {
+    int frame;
+    CameraSettings camera;
+};
+
+struct SphereKey {
+    int frame;
+    Vector3 center;
+    float radius;
+};
+
+/// Keyframes of one sphere.
+struct SphereTrack {
+    std::uint32_t sphere;
+    std::vector<SphereKey> keys;
+};
+
+/// Keyframes sorted by frame.
+struct Animation {
+    int frames = 1;
+    std::vector<CameraKey> camera_keys;
+    std::vector<SphereTrack> sphere_tracks;
+
+    /// The camera at a frame, or camera if it is not animated.
+    CameraSettings camera(int frame, CameraSettings const &camera) const;
+    /// Center and radius of the sphere of a track at a frame.
+    SphereKey sphere(SphereTrack const &track, int frame) const;
+};
+
+/// Load an animation of a scene with sphere_count spheres. Throws
+/// std::runtime_error on malformed files.
+inline Animation load_animation(std::string const &path,
+                                std::size_t sphere_count);
+
+namespace animation_detail {
+
+inline Vector3 lerp(Vector3 const &a, Vector3 const &b, float t) {
+    return (1.0f - t) * a + t * b;
+}
+
+inline float lerp(float a, float b, float t) { return (1.0f - t) * a + t * b; }
+
+inline CameraSettings lerp(CameraSettings const &a, CameraSettings const &b,
+                           float t) {
+    return CameraSettings{lerp(a.lookfrom, b.lookfrom, t),
+                          lerp(a.lookat, b.lookat, t), lerp(a.up, b.up, t),
+                          lerp(a.vfov, b.vfov, t)};
+}
+
+inline CameraKey lerp(CameraKey const &a, CameraKey const &b, float t) {
+    return CameraKey{0, lerp(a.camera, b.camera, t)};
+}
+
+inline SphereKey lerp(SphereKey const &a, SphereKey const &b, float t) {
+    return SphereKey{0, lerp(a.center, b.center, t),
+                     lerp(a.radius, b.radius, t)};
+}
+
+/// Interpolate non-empty keys, sorted by frame, at a frame.
+template <typename Key>
+Key interpolate(std::vector<Key> const &keys, int frame) {
+    auto const next = std::lower_bound(
+        keys.begin(), keys.end(), frame,
+        [](Key const &key, int f) { return key.frame < f; });
+    if (next == keys.end()) {
+        return keys.back();
+    }
+    if (next == keys.begin() || next->frame == frame) {
+        return *next;
+    }
+    Key const &previous = *(next - 1);
+    float const t = float(frame - previous.frame) /
+                    float(next->frame - previous.frame);
+    return lerp(previous, *next, t);
+}
+
+} // namespace animation_detail
+
+inline CameraSettings Animation::camera(int frame,
+                                        CameraSettings const &camera) const {
+    if (camera_keys.empty()) {
+        return camera;
+    }
+    return animation_detail::interpolate(camera_keys, frame).camera;
+}
+
+inline SphereKey Animation::sphere(SphereTrack const &track, int frame) const {
+    return animation_detail::interpolate(track.keys, frame);
+}
+
+inline Animation load_animation(std::string const &path,
+                                std::size_t sphere_count) {
+    MappedFile const file(path);
+    TextParser parser(file.data(), file.data() + file.size(), path);
+    Animation animation;
+    auto const frame = [&] {
+        float const f = parser.number();
+        if (!(f >= 0.0f && f < 1e9f) || f != float(int(f))) {
+            parser.fail("expected a frame number");
+        }
+        return int(f);
+    };
+    while (parser.next_line()) {
+        std::string_view const statement = parser.token();
+        if (statement == "frames") {
+            animation.frames = frame();
+            if (animation.frames == 0) {
+                parser.fail("expected at least one frame");
+            }
+        } else if (statement == "camera") {
+            CameraKey key;
+            key.frame = frame();
+            key.camera.lookfrom = parser.vector();
+            key.camera.lookat = parser.vector();
+            key.camera.up = parser.vector();
+            key.camera.vfov = parser.number();
+            animation.camera_keys.push_back(key);
+        } else if (statement == "sphere") {
+            SphereKey key;
+            key.frame = frame();
+            float const index = parser.number();
+            if (index < 0.0f || index != float(int(index)) ||
+                std::size_t(index) >= sphere_count) {
+                parser.fail("no such sphere");
+            }
+            key.center = parser.vector();
+            key.radius = parser.number();
+            std::uint32_t const sphere = std::uint32_t(index);
+            auto track = std::find_if(
+                animation.sphere_tracks.begin(), animation.sphere_tracks.end(),
+                [sphere](SphereTrack const &t) { return t.sphere == sphere; });
+            if (track == animation.sphere_tracks.end()) {
+                animation.sphere_tracks.push_back(SphereTrack{sphere, {}});
+                track = animation.sphere_tracks.end() - 1;
+            }
+            track->keys.push_back(key);
+        } else {
+            parser.fail("unknown statement '" + std::string(statement) + "'");
+        }
+        parser.expect_end();
+    }
+    auto const by_frame = [](auto const &a, auto const &b) {
+        return a.frame < b.frame;
+    };
+    std::stable_sort(animation.camera_keys.begin(),
+                     animation.camera_keys.end(), by_frame);
+    for (auto &track : animation.sphere_tracks) {
+        std::stable_sort(track.keys.begin(), track.keys.end(), by_frame);
+    }
+    return animation;
+}
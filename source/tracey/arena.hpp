@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+
+/// Monotonic allocator handing out memory from large cache line aligned
+/// blocks. Objects created in an arena never move and are destroyed all at
+/// once, in reverse order of creation, when the arena is cleared or
+/// destroyed; there is no way to free single objects. Consecutive objects are
+/// adjacent in memory, so walking them in creation order is a linear scan.
+class Arena {
+  public:
+    explicit Arena(std::size_t block_size = std::size_t(1) << 20)
+        : block_size(block_size) {}
+    ~Arena() { clear(); }
+
+    Arena(Arena const &) = delete;
+    Arena &operator=(Arena const &) = delete;
+    Arena(Arena &&other) noexcept { *this = std::move(other); }
+    Arena &operator=(Arena &&other) noexcept;
+
+    /// Uninitialized memory of the given size and alignment, which must be a
+    /// power of two no larger than cache_line_size.
+    void *allocate(std::size_t size, std::size_t alignment);
+
+    /// Construct a T in the arena.
+    template <typename T, typename... Args> T &create(Args &&...args);
+
+    /// Destroy all objects and release all memory.
+    void clear();
+
+    /// Bytes handed out so far.
+    std::size_t bytes_used() const { return used; }
+
+  private:
+    struct Block {
+        char *memory;
+        std::size_t size;
+    };
+    /// Destructor call for an object which is not trivially destructible.
+    struct Destructor {
+        void (*destroy)(void *);
+        void *object;
+    };
+
+    std::size_t block_size = std::size_t(1) << 20;
+    std::vector<Block> blocks;
+    std::vector<Destructor> destructors;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    std::size_t used = 0;
+};
+
+inline Arena &Arena::operator=(Arena &&other) noexcept {
+    if (this != &other) {
+        clear();
+        block_size = other.block_size;
+        blocks = std::move(other.blocks);
+        destructors = std::move(other.destructors);
+        cursor = std::exchange(other.cursor, nullptr);
+        limit = std::exchange(other.limit, nullptr);
+        used = std::exchange(other.used, 0);
+        other.blocks.clear();
+        other.destructors.clear();
+    }
+    return *this;
+}
+
+inline void *Arena::allocate(std::size_t size, std::size_t alignment) {
+    auto const aligned = [alignment](char *p) {
+        auto const address = reinterpret_cast<std::uintptr_t>(p);
+        return reinterpret_cast<char *>((address + alignment - 1) &
+                                        ~std::uintptr_t(alignment - 1));
+    };
+    char *start = cursor == nullptr ? nullptr : aligned(cursor);
+    if (start == nullptr || start + size > limit) {
+        // Oversized requests get a block of their own.
+        std::size_t const size_of_block = std::max(block_size, size);
+        char *memory = static_cast<char *>(::operator new(
+            size_of_block, std::align_val_t(cache_line_size)));
+        blocks.push_back(Block{memory, size_of_block});
+        limit = memory + size_of_block;
+        start = memory;
+    }
+    cursor = start + size;
+    used += std::size_t(cursor - start);
+    return start;
+}
+
+template <typename T, typename... Args> T &Arena::create(Args &&...args) {
+    static_assert(alignof(T) <= cache_line_size, "Alignment not supported");
+    void *memory = allocate(sizeof(T), alignof(T));
+    T *object = new (memory) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+        destructors.push_back(Destructor{
+            [](void *p) { static_cast<T *>(p)->~T(); }, object});
+    }
+    return *object;
+}
+
+inline void Arena::clear() {
+    for (auto d = destructors.rbegin(); d != destructors.rend(); ++d) {
+        d->destroy(d->object);
+    }
+    destructors.clear();
+    for (Block const &block : blocks) {
+        ::operator delete(block.memory, std::align_val_t(cache_line_size));
+    }
+    blocks.clear();
+    cursor = nullptr;
+    limit = nullptr;
+    used = 0;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "aabb.hpp"
+#include "arena.hpp"
+#include "bvh.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+
+/// Scene owning its hittables and materials, of any type, in arenas instead
+/// of pointing at objects allocated elsewhere. Materials stay where they were
+/// created. build() moves the hittables into a fresh arena in the leaf order
+/// of the hierarchy, so the objects of every leaf are adjacent in memory and
+/// traversal walks it linearly, and releases the old arena in one go.
+/// Hittables and materials are identified by stable indices in order of
+/// addition. Hittables must be move constructible and must not be referred to
+/// by other objects, as build() moves them.
+class ArenaScene final : public Hittable {
+  public:
+    /// Create a material of type M, returning its index.
+    template <typename M, typename... Args>
+    std::uint32_t add_material(Args &&...args);
+    Material const &material(std::uint32_t index) const {
+        return *materials[index];
+    }
+
+    /// Create a hittable of type H, returning its index.
+    template <typename H, typename... Args> std::uint32_t add(Args &&...args);
+    Hittable const &hittable(std::uint32_t index) const {
+        return *hittables[slots[index]];
+    }
+    /// Hittables may be changed, e.g. moved, as long as refit() or build() is
+    /// called before the next hit().
+    Hittable &hittable(std::uint32_t index) {
+        return *hittables[slots[index]];
+    }
+    std::size_t size() const { return hittables.size(); }
+
+    /// Build the hierarchy over all hittables. Must be called after adding
+    /// hittables and before hit(). Throws std::invalid_argument for unbounded
+    /// hittables.
+    void build();
+
+    /// Update the hierarchy to hittables moved since build(), keeping its
+    /// structure; see BvhTree::refit().
+    void refit();
+
+    bool hit(Ray const &r, float t_min, float t_max,
+             HitRecord &rec) const override;
+    bool bounding_box(Aabb &box) const override;
+
+  private:
+    /// Move a hittable of the type it was created with into an arena.
+    using Relocate = Hittable *(*)(Hittable &, Arena &);
+
+    Arena material_arena;
+    Arena hittable_arena;
+    std::vector<Material const *> materials;
+    /// Hittables in leaf order after build(), with their relocate functions.
+    std::vector<Hittable *> hittables;
+    std::vector<Relocate> relocators;
+    /// Position in hittables of every hittable index.
+    std::vector<std::uint32_t> slots;
+    BvhTree tree;
+};
+
+template <typename M, typename... Args>
+std::uint32_t ArenaScene::add_material(Args &&...args) {
+    materials.push_back(
+        &material_arena.create<M>(std::forward<Args>(args)...));
+    return std::uint32_t(materials.size() - 1);
+}
+
+template <typename H, typename... Args>
+std::uint32_t ArenaScene::add(Args &&...args) {
+    hittables.push_back(&hittable_arena.create<H>(std::forward<Args>(args)...));
+    relocators.push_back([](Hittable &h, Arena &arena) -> Hittable * {
+        return &arena.create<H>(std::move(static_cast<H &>(h)));
+    });
+    slots.push_back(std::uint32_t(hittables.size() - 1));
+    return slots.back();
+}
+
+inline void ArenaScene::build() {
+    std::vector<Aabb> bounds(hittables.size());
+    for (std::size_t i = 0; i != hittables.size(); ++i) {
+        if (!hittables[i]->bounding_box(bounds[i])) {
+            throw std::invalid_argument(
+                "ArenaScene cannot hold unbounded hittables");
+        }
+    }
+    tree.build(bounds);
+    Arena arena;
+    std::vector<Hittable *> ordered;
+    std::vector<Relocate> ordered_relocators;
+    std::vector<std::uint32_t> position(hittables.size());
+    ordered.reserve(hittables.size());
+    ordered_relocators.reserve(hittables.size());
+    for (std::uint32_t index : tree.order()) {
+        position[index] = std::uint32_t(ordered.size());
+        ordered.push_back(relocators[index](*hittables[index], arena));
+        ordered_relocators.push_back(relocators[index]);
+    }
+    for (auto &slot : slots) {
+        slot = position[slot];
+    }
+    hittables = std::move(ordered);
+    relocators = std::move(ordered_relocators);
+    hittable_arena = std::move(arena);
+}
+
+inline void ArenaScene::refit() {
+    std::vector<Aabb> bounds(hittables.size());
+    for (std::size_t i = 0; i != hittables.size(); ++i) {
+        hittables[i]->bounding_box(bounds[i]);
+    }
+    tree.refit(bounds);
+}
+
+inline bool ArenaScene::hit(Ray const &r, float t_min, float t_max,
+                            HitRecord &rec) const {
+    HitRecord temp_rec;
+    float closest_so_far = t_max;
+    return tree.traverse(
+        r, t_min, closest_so_far,
+        [&](std::uint32_t first, std::uint32_t count, float &closest) {
+            bool hit_anything = false;
+            for (std::uint32_t i = first; i != first + count; ++i) {
+                if (hittables[i]->hit(r, t_min, closest, temp_rec)) {
+                    hit_anything = true;
+                    closest = temp_rec.t;
+                    rec = temp_rec;
+                }
+            }
+            return hit_anything;
+        });
+}
+
+inline bool ArenaScene::bounding_box(Aabb &box) const {
+    if (tree.empty()) {
+        return false;
+    }
+    box = tree.bounds();
+    return true;
+}
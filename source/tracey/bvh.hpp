@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "render_stats.hpp"
+
+/// Bounding volume hierarchy over primitives known only by their bounds. It
+/// does not store the primitives itself: build() computes an order in which
+/// the owner should store them, so that every leaf covers a contiguous range,
+/// and traverse() hands those ranges back for intersection. This lets
+/// containers with and without virtual primitives share one implementation.
+/// Construction uses the binned surface area heuristic; traversal visits the
+/// nearer child first and is O(log N) for well distributed scenes.
+class BvhTree {
+  public:
+    /// Build the hierarchy over primitives with the given bounds. Afterwards
+    /// primitive order()[k] belongs at position k.
+    void build(std::vector<Aabb> const &bounds);
+
+    /// Recompute the bounds of all nodes from new bounds of the primitives,
+    /// given in leaf order, keeping the structure of the hierarchy. This is
+    /// much cheaper than build() for moving primitives, but the hierarchy
+    /// gets worse the further they move from where they were at build().
+    void refit(std::vector<Aabb> const &bounds);
+
+    /// Primitive indices in leaf order, as computed by build().
+    std::vector<std::uint32_t> const &order() const { return primitive_order; }
+
+    /// Walk the leaves whose bounds the ray enters before closest, calling
+    /// hit_leaf(first, count, closest) for the leaf range [first, first +
+    /// count). hit_leaf returns whether it found a hit, after lowering closest
+    /// to its distance. Returns whether any leaf reported a hit.
+    template <typename LeafFunction>
+    bool traverse(Ray const &r, float t_min, float &closest,
+                  LeafFunction &&hit_leaf) const;
+
+    bool empty() const { return nodes.empty(); }
+    Aabb const &bounds() const { return nodes.front().bounds; }
+
+    /// Number of nodes in the hierarchy, mostly for diagnostics.
+    std::size_t node_count() const { return nodes.size(); }
+
+    /// Leaves never hold more primitives than this.
+    static constexpr std::size_t max_leaf_size = 8;
+
+  private:
+    struct Node {
+        Aabb bounds;
+        /// First primitive for a leaf, index of the second child for an
+        /// interior node. The first child always directly follows its parent.
+        std::uint32_t offset;
+        /// Number of primitives in a leaf, zero for interior nodes.
+        std::uint16_t count;
+        /// Split axis of an interior node, used to order the traversal.
+        std::uint16_t axis;
+    };
+
+    struct BuildItem {
+        Aabb bounds;
+        Vector3 centroid;
+        std::uint32_t index;
+    };
+
+    static constexpr int bin_count = 16;
+    /// Beyond this depth the builder falls back to median splits, which keeps
+    /// the tree shallow enough for the fixed traversal stack.
+    static constexpr int max_sah_depth = 40;
+    static constexpr int stack_capacity = max_sah_depth + 64;
+    /// Cost of visiting a node relative to intersecting one primitive.
+    static constexpr float traversal_cost = 1.0f;
+
+    void build_node(std::vector<BuildItem> &items, std::size_t begin,
+                    std::size_t end, int depth);
+
+    std::vector<Node> nodes;
+    std::vector<std::uint32_t> primitive_order;
+};
+
+/// Bounding volume hierarchy over a set of hittables. It is a drop-in
+/// replacement for Composite: add the hittables, call build() once, then use
+/// it as any other Hittable.
+class Bvh : public Hittable {
+  public:
+    Bvh() = default;
+    explicit Bvh(std::vector<Hittable *> objects)
+        : hittables(std::move(objects)) {
+        build();
+    }
+
+    void add_hittable(Hittable &h) { hittables.push_back(&h); }
+
+    /// (Re)build the hierarchy over all added hittables. Must be called before
+    /// hit() whenever hittables were added. Throws std::invalid_argument for
+    /// unbounded hittables.
+    void build();
+
+    bool hit(Ray const &r, float t_min, float t_max,
+             HitRecord &rec) const override;
+    bool bounding_box(Aabb &box) const override;
+
+    /// Number of nodes in the hierarchy, mostly for diagnostics.
+    std::size_t node_count() const { return tree.node_count(); }
+
+    /// Hittables, reordered by build() so every leaf covers a contiguous range.
+    std::vector<Hittable *> hittables;
+
+  private:
+    BvhTree tree;
+};
+
+inline void BvhTree::build(std::vector<Aabb> const &bounds) {
+    nodes.clear();
+    primitive_order.clear();
+    if (bounds.empty()) {
+        return;
+    }
+    std::vector<BuildItem> items;
+    items.reserve(bounds.size());
+    for (std::size_t i = 0; i != bounds.size(); ++i) {
+        items.push_back(
+            BuildItem{bounds[i], bounds[i].centroid(), std::uint32_t(i)});
+    }
+    nodes.reserve(2 * items.size());
+    build_node(items, 0, items.size(), 0);
+    primitive_order.reserve(items.size());
+    for (auto const &item : items) {
+        primitive_order.push_back(item.index);
+    }
+    // Leaves hold several primitives, so far fewer nodes than reserved are
+    // used. Give the rest back, after the build items, which matters for
+    // large meshes.
+    std::vector<BuildItem>().swap(items);
+    nodes.shrink_to_fit();
+}
+
+inline void BvhTree::refit(std::vector<Aabb> const &bounds) {
+    // Children always follow their parent, so walking the nodes backwards
+    // visits children before parents.
+    for (std::size_t n = nodes.size(); n-- != 0;) {
+        Node &node = nodes[n];
+        Aabb box;
+        if (node.count > 0) {
+            for (std::uint32_t i = node.offset; i != node.offset + node.count;
+                 ++i) {
+                box.expand(bounds[i]);
+            }
+        } else {
+            box.expand(nodes[n + 1].bounds);
+            box.expand(nodes[node.offset].bounds);
+        }
+        node.bounds = box;
+    }
+}
+
+inline void BvhTree::build_node(std::vector<BuildItem> &items,
+                                std::size_t begin, std::size_t end,
+                                int depth) {
+    std::size_t const node_index = nodes.size();
+    nodes.push_back(Node{});
+    Aabb bounds;
+    Aabb centroid_bounds;
+    for (std::size_t i = begin; i != end; ++i) {
+        bounds.expand(items[i].bounds);
+        centroid_bounds.expand(items[i].centroid);
+    }
+    nodes[node_index].bounds = bounds;
+    std::size_t const count = end - begin;
+
+    auto make_leaf = [&] {
+        nodes[node_index].offset = std::uint32_t(begin);
+        nodes[node_index].count = std::uint16_t(count);
+        nodes[node_index].axis = 0;
+    };
+    if (count == 1) {
+        make_leaf();
+        return;
+    }
+
+    // Pick the split axis as the one with the largest centroid extent.
+    Vector3 const extent = centroid_bounds.maximum - centroid_bounds.minimum;
+    int axis = 0;
+    if (extent[1] > extent[axis]) {
+        axis = 1;
+    }
+    if (extent[2] > extent[axis]) {
+        axis = 2;
+    }
+    if (extent[axis] <= 0.0f) {
+        // All centroids coincide, nothing to gain from splitting.
+        if (count <= max_leaf_size) {
+            make_leaf();
+            return;
+        }
+    }
+
+    std::size_t middle = begin;
+    if (extent[axis] > 0.0f && depth < max_sah_depth) {
+        // Bin the centroids and evaluate the surface area heuristic for every
+        // bin boundary.
+        struct Bin {
+            Aabb bounds;
+            std::size_t count = 0;
+        };
+        std::array<Bin, bin_count> bins;
+        float const origin = centroid_bounds.minimum[axis];
+        float const scale = float(bin_count) / extent[axis];
+        auto bin_of = [&](BuildItem const &item) {
+            int const b = int((item.centroid[axis] - origin) * scale);
+            return std::min(std::max(b, 0), bin_count - 1);
+        };
+        for (std::size_t i = begin; i != end; ++i) {
+            Bin &bin = bins[std::size_t(bin_of(items[i]))];
+            bin.bounds.expand(items[i].bounds);
+            ++bin.count;
+        }
+        std::array<float, bin_count - 1> right_cost;
+        Aabb right_bounds;
+        std::size_t right_count = 0;
+        for (int b = bin_count - 1; b > 0; --b) {
+            right_bounds.expand(bins[std::size_t(b)].bounds);
+            right_count += bins[std::size_t(b)].count;
+            right_cost[std::size_t(b - 1)] =
+                right_bounds.surface_area() * float(right_count);
+        }
+        Aabb left_bounds;
+        std::size_t left_count = 0;
+        float best_cost = std::numeric_limits<float>::max();
+        int best_split = -1;
+        for (int b = 0; b != bin_count - 1; ++b) {
+            left_bounds.expand(bins[std::size_t(b)].bounds);
+            left_count += bins[std::size_t(b)].count;
+            float const cost = left_bounds.surface_area() * float(left_count) +
+                               right_cost[std::size_t(b)];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+        float const area = bounds.surface_area();
+        float const split_cost =
+            traversal_cost + (area > 0.0f ? best_cost / area : 0.0f);
+        if (count <= max_leaf_size && split_cost >= float(count)) {
+            make_leaf();
+            return;
+        }
+        middle = std::size_t(
+            std::partition(items.begin() + std::ptrdiff_t(begin),
+                           items.begin() + std::ptrdiff_t(end),
+                           [&](BuildItem const &item) {
+                               return bin_of(item) <= best_split;
+                           }) -
+            items.begin());
+    }
+    if (middle == begin || middle == end) {
+        // No useful SAH split: split at the median along the axis instead.
+        middle = begin + count / 2;
+        std::nth_element(items.begin() + std::ptrdiff_t(begin),
+                         items.begin() + std::ptrdiff_t(middle),
+                         items.begin() + std::ptrdiff_t(end),
+                         [axis](BuildItem const &a, BuildItem const &b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+    }
+
+    build_node(items, begin, middle, depth + 1);
+    nodes[node_index].offset = std::uint32_t(nodes.size());
+    nodes[node_index].count = 0;
+    nodes[node_index].axis = std::uint16_t(axis);
+    build_node(items, middle, end, depth + 1);
+}
+
+template <typename LeafFunction>
+bool BvhTree::traverse(Ray const &r, float t_min, float &closest,
+                       LeafFunction &&hit_leaf) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    Vector3 const &origin = r.origin();
+    Vector3 const inv_direction = rcp(r.direction());
+    bool const negative[3] = {inv_direction.x() < 0.0f,
+                              inv_direction.y() < 0.0f,
+                              inv_direction.z() < 0.0f};
+    std::uint32_t stack[stack_capacity];
+    int stack_size = 0;
+    std::uint32_t current = 0;
+    bool hit_anything = false;
+    TRACEY_STAT(std::uint64_t visited = 0;)
+    for (;;) {
+        Node const &node = nodes[current];
+        TRACEY_STAT(++visited;)
+        if (node.bounds.hit(origin, inv_direction, t_min, closest)) {
+            if (node.count > 0) {
+                if (hit_leaf(node.offset, std::uint32_t(node.count), closest)) {
+                    hit_anything = true;
+                }
+            } else {
+                // Descend into the child nearer along the split axis first.
+                if (negative[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size];
+    }
+    TRACEY_STAT(thread_stats().nodes_visited.add(visited);)
+    return hit_anything;
+}
+
+inline void Bvh::build() {
+    std::vector<Aabb> bounds(hittables.size());
+    for (std::size_t i = 0; i != hittables.size(); ++i) {
+        if (!hittables[i]->bounding_box(bounds[i])) {
+            throw std::invalid_argument("Bvh cannot hold unbounded hittables");
+        }
+    }
+    tree.build(bounds);
+    std::vector<Hittable *> ordered;
+    ordered.reserve(hittables.size());
+    for (std::uint32_t index : tree.order()) {
+        ordered.push_back(hittables[index]);
+    }
+    hittables = std::move(ordered);
+}
+
+inline bool Bvh::hit(Ray const &r, float t_min, float t_max,
+                     HitRecord &rec) const {
+    HitRecord temp_rec;
+    float closest_so_far = t_max;
+    return tree.traverse(
+        r, t_min, closest_so_far,
+        [&](std::uint32_t first, std::uint32_t count, float &closest) {
+            bool hit_anything = false;
+            for (std::uint32_t i = first; i != first + count; ++i) {
+                if (hittables[i]->hit(r, t_min, closest, temp_rec)) {
+                    hit_anything = true;
+                    closest = temp_rec.t;
+                    rec = temp_rec;
+                }
+            }
+            return hit_anything;
+        });
+}
+
+inline bool Bvh::bounding_box(Aabb &box) const {
+    if (tree.empty()) {
+        return false;
+    }
+    box = tree.bounds();
+    return true;
+}
@@ -24,7 +24,7 @@ class Camera {
 
         /// Given two values in the range [0, 1] denoting coordinates on the plane in front of the camera,
         /// generate a ray from the center of the camera, passing through those coordinates. 
-        Ray get_ray(float s, float t) {
+        Ray get_ray(float s, float t) const {
             return Ray(origin, lower_left_corner + s*horizontal + t*vertical - origin);
         }
 
@@ -8,6 +8,7 @@ class Composite : public Hittable  {
     public:
         Composite() = default;
         virtual bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const;
+        virtual bool bounding_box(Aabb& box) const;
         void add_hittable(Hittable & h) {
             hittables.push_back(&h);
         }
@@ -28,3 +29,16 @@ bool Composite::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
     }
     return hit_anything;
 }
+
+bool Composite::bounding_box(Aabb& box) const
+{
+    box = Aabb();
+    for (auto & curr : hittables) {
+        Aabb curr_box;
+        if (!curr->bounding_box(curr_box)) {
+            return false;
+        }
+        box.expand(curr_box);
+    }
+    return !hittables.empty();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Runtime detection of the vector instruction sets used by the hand written
+// intersection kernels. Kernels are compiled with per-function target
+// attributes, so the rest of the program keeps the baseline instruction set
+// and a single binary runs on any x86-64 machine.
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define TRACEY_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define TRACEY_X86_KERNELS 0
+#endif
+
+/// Widest kernel variants, in increasing order of width.
+enum class SimdLevel { scalar, sse2, avx2, avx512 };
+
+inline char const *simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::sse2:
+        return "sse2";
+    case SimdLevel::avx2:
+        return "avx2";
+    case SimdLevel::avx512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+/// Whether the CPU running the program supports the given level.
+inline bool simd_level_supported(SimdLevel level) {
+#if TRACEY_X86_KERNELS
+    switch (level) {
+    case SimdLevel::sse2:
+        return __builtin_cpu_supports("sse2");
+    case SimdLevel::avx2:
+        return __builtin_cpu_supports("avx2");
+    case SimdLevel::avx512:
+        return __builtin_cpu_supports("avx512f");
+    default:
+        return true;
+    }
+#else
+    return level == SimdLevel::scalar;
+#endif
+}
+
+/// Widest level supported by the CPU, determined once.
+inline SimdLevel best_simd_level() {
+    static SimdLevel const level = [] {
+        for (SimdLevel l : {SimdLevel::avx512, SimdLevel::avx2,
+                            SimdLevel::sse2}) {
+            if (simd_level_supported(l)) {
+                return l;
+            }
+        }
+        return SimdLevel::scalar;
+    }();
+    return level;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+// Whole-file input shared by the scene and model loaders: a file memory
+// mapped where the platform allows it, and a line and token splitter for the
+// text formats.
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRACEY_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define TRACEY_HAS_MMAP 0
+#endif
+
+#include "vector3.hpp"
+
+#if defined(__BYTE_ORDER__)
+/// Whether the host stores numbers little endian. The binary formats are
+/// little endian and read and written in host byte order, so they need it.
+constexpr bool const host_little_endian =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+// MSVC, which only targets little endian machines.
+constexpr bool const host_little_endian = true;
+#endif
+
+/// Read-only view of a whole file, memory mapped where possible.
+class MappedFile {
+  public:
+    explicit MappedFile(std::string const &path);
+    ~MappedFile();
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    char const *data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+  private:
+    char const *bytes = nullptr;
+    std::size_t length = 0;
+    bool mapped = false;
+    std::vector<char> buffer;
+};
+
+inline MappedFile::MappedFile(std::string const &path) {
+#if TRACEY_HAS_MMAP
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(path + ": unable to open file");
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        length = std::size_t(info.st_size);
+        void *address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            bytes = static_cast<char const *>(address);
+            mapped = true;
+        }
+    }
+    ::close(fd);
+    if (mapped || length == 0) {
+        return;
+    }
+#endif
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error(path + ": unable to open file");
+    }
+    buffer.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    bytes = buffer.data();
+    length = buffer.size();
+}
+
+inline MappedFile::~MappedFile() {
+#if TRACEY_HAS_MMAP
+    if (mapped) {
+        ::munmap(const_cast<char *>(bytes), length);
+    }
+#endif
+}
+
+/// Splits text into lines and whitespace separated tokens, reporting errors
+/// with the file name and line number.
+class TextParser {
+  public:
+    TextParser(char const *begin, char const *end, std::string const &path)
+        : next(begin), end(end), path(path) {}
+
+    /// Advance to the next line with content. Returns false at the end.
+    bool next_line();
+    /// Next token of the current line, empty at its end.
+    std::string_view token();
+    float number();
+    Vector3 vector();
+    /// Fail unless the current line has no tokens left.
+    void expect_end();
+    [[noreturn]] void fail(std::string const &message) const;
+
+  private:
+    char const *next;
+    char const *end;
+    char const *cursor = nullptr;
+    char const *line_end = nullptr;
+    std::size_t line = 0;
+    std::string const &path;
+};
+
+inline bool TextParser::next_line() {
+    while (next != end) {
+        ++line;
+        cursor = next;
+        line_end = static_cast<char const *>(
+            std::memchr(cursor, '\n', std::size_t(end - cursor)));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        next = line_end == end ? end : line_end + 1;
+        if (char const *comment = static_cast<char const *>(
+                std::memchr(cursor, '#', std::size_t(line_end - cursor)))) {
+            line_end = comment;
+        }
+        char const *c = cursor;
+        while (c != line_end &&
+               (*c == ' ' || *c == '\t' || *c == '\r')) {
+            ++c;
+        }
+        if (c != line_end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline std::string_view TextParser::token() {
+    auto const space = [](char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    };
+    while (cursor != line_end && space(*cursor)) {
+        ++cursor;
+    }
+    char const *first = cursor;
+    while (cursor != line_end && !space(*cursor)) {
+        ++cursor;
+    }
+    return std::string_view(first, std::size_t(cursor - first));
+}
+
+inline float TextParser::number() {
+    std::string_view const t = token();
+    float value = 0.0f;
+    auto const result = std::from_chars(t.data(), t.data() + t.size(), value);
+    if (t.empty() || result.ec != std::errc() ||
+        result.ptr != t.data() + t.size()) {
+        fail("expected a number, got '" + std::string(t) + "'");
+    }
+    return value;
+}
+
+inline Vector3 TextParser::vector() {
+    float const x = number();
+    float const y = number();
+    float const z = number();
+    return Vector3(x, y, z);
+}
+
+inline void TextParser::expect_end() {
+    std::string_view const t = token();
+    if (!t.empty()) {
+        fail("unexpected '" + std::string(t) + "'");
+    }
+}
+
+inline void TextParser::fail(std::string const &message) const {
+    throw std::runtime_error(path + ":" + std::to_string(line) + ": " +
+                             message);
+}
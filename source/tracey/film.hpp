@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "tile_renderer.hpp"
+#include "vector3.hpp"
+
+using Color = Vector3;
+
+/// Framebuffer of linear colors in one contiguous, cache line aligned,
+/// row-major block. Row 0 is the bottom row of the image, matching the
+/// camera's v coordinate; resolve() flips the rows into the top-down order
+/// image files use. A film may cover just a region of the image, e.g. one
+/// band of rows when streaming, and is always addressed with image
+/// coordinates.
+class Film {
+  public:
+    /// Pixels of one tile of a film, addressed with image coordinates.
+    class TileView {
+      public:
+        TileView(Film &film, Tile const &tile) : film(film), tile(tile) {}
+        Color &at(int i, int j) { return film.at(i, j); }
+        void accumulate(int i, int j, Color const &c) { film.at(i, j) += c; }
+        Tile const &bounds() const { return tile; }
+
+      private:
+        Film &film;
+        Tile tile;
+    };
+
+    Film() = default;
+    Film(int width, int height) { resize(width, height); }
+
+    explicit Film(Tile const &region) { resize(region); }
+
+    /// Resize to width times height pixels, all black.
+    void resize(int width, int height) { resize(Tile{0, 0, width, height}); }
+
+    /// Resize to cover region of the image, all black. Reuses the storage if
+    /// it is large enough.
+    void resize(Tile const &region) {
+        film_region = region;
+        pixels.assign(std::size_t(width()) * std::size_t(height()),
+                      Color(0.0f, 0.0f, 0.0f));
+    }
+
+    void clear() { std::fill(pixels.begin(), pixels.end(), Color(0, 0, 0)); }
+
+    int width() const { return film_region.x_end - film_region.x_begin; }
+    int height() const { return film_region.y_end - film_region.y_begin; }
+    Tile const &region() const { return film_region; }
+
+    Color &at(int i, int j) { return pixels[index(i, j)]; }
+    Color const &at(int i, int j) const { return pixels[index(i, j)]; }
+    void accumulate(int i, int j, Color const &c) { pixels[index(i, j)] += c; }
+
+    TileView view(Tile const &tile) { return TileView(*this, tile); }
+
+    Color *data() { return pixels.data(); }
+    Color const *data() const { return pixels.data(); }
+
+    /// Resolve to 8 bit RGB, top row first, ready for the image writers:
+    /// every pixel is divided by its sample count, gamma corrected and
+    /// quantized. samples(i, j) returns the sample count of a pixel.
+    template <typename SampleCount>
+    void resolve(std::vector<std::uint8_t> &rgb, SampleCount &&samples) const;
+
+    /// Resolve with the same sample count for every pixel.
+    void resolve(std::vector<std::uint8_t> &rgb, int samples) const {
+        resolve(rgb, [samples](int, int) { return samples; });
+    }
+
+  private:
+    std::size_t index(int i, int j) const {
+        return std::size_t(j - film_region.y_begin) * std::size_t(width()) +
+               std::size_t(i - film_region.x_begin);
+    }
+
+    Tile film_region{0, 0, 0, 0};
+    std::vector<Color, AlignedAllocator<Color, cache_line_size>> pixels;
+};
+
+// Gamma correction - a lot of image viewers assume that the output is gamma
+// corrected. For our purposes, just applying sqrt to each of the values is
+// sufficient.
+inline Color gamma_correction(Color const &color) {
+    return Color(std::sqrt(color.r()), std::sqrt(color.g()),
+                 std::sqrt(color.b()));
+}
+
+/// Map a gamma corrected channel from [0, 1] to [0, 255].
+inline std::uint8_t quantize(float channel) {
+    return std::uint8_t(std::clamp(int(channel * 255.0f), 0, 255));
+}
+
+template <typename SampleCount>
+void Film::resolve(std::vector<std::uint8_t> &rgb,
+                   SampleCount &&samples) const {
+    rgb.resize(3 * pixels.size());
+    std::uint8_t *out = rgb.data();
+    Tile const &r = film_region;
+    for (int j = r.y_end - 1; j >= r.y_begin; --j) {
+        Color const *row = &pixels[index(r.x_begin, j)];
+        for (int i = r.x_begin; i != r.x_end; ++i) {
+            int const n = samples(i, j);
+            Color const pixel =
+                gamma_correction(n == 0 ? Color(0, 0, 0)
+                                        : row[i - r.x_begin] / float(n));
+            *out++ = quantize(pixel.r());
+            *out++ = quantize(pixel.g());
+            *out++ = quantize(pixel.b());
+        }
+    }
+}
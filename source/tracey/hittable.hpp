@@ -1,6 +1,9 @@
 #pragma once
 
-#include "Ray.hpp"
+#include <cstdint>
+
+#include "aabb.hpp"
+#include "ray.hpp"
 
 class Material;
 
@@ -9,10 +12,17 @@ struct HitRecord {
     Vector3 p;
     Vector3 normal;
     Material const* material;
+    /// Index of the material in worlds which keep their materials in an
+    /// indexed table (see StaticScene); unused otherwise.
+    std::uint32_t material_index;
 };
 
 class Hittable  {
 public:
     virtual bool hit(Ray const& r, float t_min, float t_max, HitRecord & rec) const = 0;
+    /// Store the bounds of the object in box. Returns false if the object is
+    /// unbounded, which is the default for hittables not overriding it; Bvh
+    /// and ArenaScene reject those.
+    virtual bool bounding_box(Aabb & /*box*/) const { return false; }
     virtual ~Hittable() = default;
 };
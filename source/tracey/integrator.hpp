@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hittable.hpp"
+#include "material.hpp"
+#include "ray.hpp"
+#include "sampling.hpp"
+#include "vector3.hpp"
+
+/// Maximum reflection depth.
+constexpr int const max_depth = 30;
+
+/// Number of bounces after which paths are subject to Russian roulette.
+constexpr int const roulette_depth = 3;
+
+/// Image and sampling parameters shared by the integrators.
+struct RenderSettings {
+    int width;
+    int height;
+    /// Samples per pixel.
+    int samples;
+    std::uint64_t seed;
+    SampleSequence sequence = SampleSequence::random;
+};
+
+/// Which samples an integrator takes in a tile: samples [begin, end) of every
+/// pixel whose entry in active (tile local, row by row) is non-zero, or of all
+/// pixels if active is null.
+struct SampleRequest {
+    int begin;
+    int end;
+    std::vector<std::uint8_t> const *active = nullptr;
+
+    bool is_active(std::size_t pixel) const {
+        return active == nullptr || (*active)[pixel] != 0;
+    }
+};
+
+/// Relative luminance of a linear RGB color.
+inline float luminance(Vector3 const &color) {
+    return 0.2126f * color.r() + 0.7152f * color.g() + 0.0722f * color.b();
+}
+
+/// Per pixel sample statistics of a tile, row by row: the sum of the sample
+/// colors and the sum of the squared sample luminances, from which the
+/// progressive renderer estimates the noise.
+struct TileAccumulator {
+    void reset(std::size_t pixels) {
+        sum.assign(pixels, Vector3(0.0f, 0.0f, 0.0f));
+        sum_squares.assign(pixels, 0.0f);
+    }
+
+    void add(std::size_t pixel, Vector3 const &color) {
+        sum[pixel] += color;
+        float const l = luminance(color);
+        sum_squares[pixel] += l * l;
+    }
+
+    std::vector<Vector3> sum;
+    std::vector<float> sum_squares;
+};
+
+/// Sampler for sample s of pixel (i, j). Every pixel sample has its own random
+/// sequence, so an image depends only on the seed and not on the tiling, the
+/// integrator's traversal order or on which thread rendered what.
+///
+/// With a low discrepancy sequence the samples of a pixel are the points of
+/// one pattern, scrambled per pixel so that neighbouring pixels do not share
+/// their errors. For blue noise all pixels share one pattern instead, each
+/// taking a block of points in the shuffled Morton order of the pixels. Its
+/// indices wrap around beyond 2^32 points, e.g. at 4096 by 4096 pixels and
+/// more than 256 samples.
+inline Sampler pixel_sampler(RenderSettings const &settings, int i, int j,
+                             int s) {
+    std::uint64_t const pixel =
+        std::uint64_t(j) * std::uint64_t(settings.width) + std::uint64_t(i);
+    Sampler sampler(mix_seed(settings.seed, std::uint64_t(s)), pixel);
+    if (settings.sequence == SampleSequence::blue_noise) {
+        int levels = 0;
+        while ((1 << levels) < std::max(settings.width, settings.height)) {
+            ++levels;
+        }
+        int sample_bits = 0;
+        while ((1 << sample_bits) < settings.samples) {
+            ++sample_bits;
+        }
+        auto const pattern = std::uint32_t(mix_seed(settings.seed, 0));
+        std::uint32_t const block = sample_sequences::shuffled_morton_index(
+            std::uint32_t(i), std::uint32_t(j), levels, pattern);
+        sampler.use_sequence(settings.sequence,
+                             (block << sample_bits) + std::uint32_t(s),
+                             std::uint32_t(settings.samples), pattern);
+    } else if (settings.sequence != SampleSequence::random) {
+        sampler.use_sequence(settings.sequence, std::uint32_t(s),
+                             std::uint32_t(settings.samples),
+                             std::uint32_t(mix_seed(settings.seed, pixel)));
+    }
+    return sampler;
+}
+
+/// Color seen along a ray which leaves the scene.
+inline Vector3 sky_color(Ray const &r) {
+    Vector3 unit_direction = unit_vector(r.direction());
+    float t = 0.5f * (unit_direction.y() + 1.0f);
+    return (1.0f - t) * Vector3(1.0f, 1.0f, 1.0f) +
+           t * Vector3(0.45f, 0.65f, 1.0f);
+}
+
+/// Russian roulette: after roulette_depth bounces a path survives with a
+/// probability equal to its largest throughput component, and survivors are
+/// reweighted by the inverse of that probability. This keeps the estimate
+/// unbiased while ending dim paths early. Returns false if the path ends.
+inline bool russian_roulette(Vector3 &throughput, int bounces,
+                             Sampler &sampler) {
+    if (bounces < roulette_depth) {
+        return true;
+    }
+    float const survival =
+        std::min(1.0f, std::max(throughput.r(),
+                                std::max(throughput.g(), throughput.b())));
+    if (sampler.next_float() >= survival) {
+        return false;
+    }
+    throughput /= survival;
+    return true;
+}
+
+/// Scatter a ray at a hit with the material of the hit. The integrators call
+/// this unqualified, so worlds with a closed set of materials can overload it
+/// to avoid the virtual call (see StaticScene).
+inline bool scatter(Hittable const &, Ray const &ray, HitRecord const &record,
+                    Vector3 &attenuation, Ray &scattered, Sampler &sampler) {
+    return record.material->scatter(ray, record, attenuation, scattered,
+                                    sampler);
+}
+
+/// Type of the material at a hit; overloadable like scatter().
+inline MaterialType material_type(Hittable const &, HitRecord const &record) {
+    return record.material->type();
+}
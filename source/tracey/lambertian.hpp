@@ -5,18 +5,19 @@
 #include "ray.hpp"
 #include "sampling.hpp"
 
-class Lambertian : public Material {
+class Lambertian final : public Material {
 public:
-    Lambertian(Vector3 const& attenuation) : albedo(attenuation) {}
-    bool scatter(Ray const& ray, HitRecord const& record, Vector3 & attenuation, Ray & scattered) const override;
+    Lambertian(Vector3 const& attenuation) : Material(MaterialType::lambertian), albedo(attenuation) {}
+    bool scatter(Ray const& ray, HitRecord const& record, Vector3 & attenuation, Ray & scattered, Sampler & sampler) const override;
+    Vector3 const& attenuation() const { return albedo; }
 
 private:
     Vector3 albedo;
 };
 
-bool Lambertian::scatter(Ray const& ray, HitRecord const& record, Vector3 & attenuation, Ray & scattered) const
+bool Lambertian::scatter([[maybe_unused]] Ray const& ray, HitRecord const& record, Vector3 & attenuation, Ray & scattered, Sampler & sampler) const
 {
-    Vector3 target = record.p + record.normal + random_vector_in_unit_sphere();
+    Vector3 target = record.p + record.normal + random_vector_in_unit_sphere(sampler);
     scattered = Ray(record.p, target - record.p);
     attenuation = albedo;
     return true;
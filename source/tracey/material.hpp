@@ -3,9 +3,29 @@
 #include "vector3.hpp"
 #include "ray.hpp"
 #include "hittable.hpp"
+#include "sampling.hpp"
+
+/// Material families the batched integrators can shade without virtual calls.
+/// Materials defined outside tracey are `other`.
+enum class MaterialType { lambertian, metal, other };
+
+class Lambertian;
+class Metal;
 
 class Material {
 public:
-    virtual bool scatter(Ray const& ray, HitRecord const& record, Vector3 & attenuation, Ray & scattered) const = 0;
+    Material() = default;
+    virtual bool scatter(Ray const& ray, HitRecord const& record, Vector3 & attenuation, Ray & scattered, Sampler & sampler) const = 0;
+    /// The family of the material. Only the final classes of the families
+    /// can set it, so a material of type lambertian or metal is exactly a
+    /// Lambertian or Metal and may be cast to it.
+    MaterialType type() const { return family; }
     virtual ~Material() {}
+
+private:
+    friend class Lambertian;
+    friend class Metal;
+    explicit Material(MaterialType family) : family(family) {}
+
+    MaterialType family = MaterialType::other;
 };
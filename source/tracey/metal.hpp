@@ -4,18 +4,21 @@
 #include "ray.hpp"
 #include "vector3.hpp"
 
-class Metal : public Material {
+class Metal final : public Material {
   public:
-    Metal(Vector3 const &attenuation) : albedo(attenuation) {}
+    Metal(Vector3 const &attenuation)
+        : Material(MaterialType::metal), albedo(attenuation) {}
     bool scatter(Ray const &ray, HitRecord const &record, Vector3 &attenuation,
-                 Ray &scattered) const override;
+                 Ray &scattered, Sampler &sampler) const override;
+    Vector3 const &attenuation() const { return albedo; }
 
   private:
     Vector3 albedo;
 };
 
 bool Metal::scatter(Ray const &ray, HitRecord const &record,
-                    Vector3 &attenuation, Ray &scattered) const {
+                    Vector3 &attenuation, Ray &scattered,
+                    [[maybe_unused]] Sampler &sampler) const {
     Vector3 reflected = reflect(unit_vector(ray.direction()), record.normal);
     scattered = Ray(record.p, reflected);
     attenuation = albedo;
@@ -0,0 +1,89 @@
+#pragma once
+
+// Loader for the geometry of Wavefront OBJ files. Only vertex positions
+// ("v x y z") and faces ("f" with one or more vertex references, each of
+// the form v, v/vt, v//vn or v/vt/vn) are read; polygons are split into fans
+// of triangles, and negative indices count back from the last vertex. All
+// other statements, texture coordinates, normals, groups and materials among
+// them, are skipped.
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "file_input.hpp"
+#include "triangle_mesh.hpp"
+
+/// Load the triangles of an OBJ file into a mesh, which still has to be
+/// built and given a material. Throws std::runtime_error on malformed files.
+inline TriangleMesh load_obj(std::string const &path);
+
+namespace obj_loader_detail {
+
+/// Vertex index of a face vertex reference, resolved against the number of
+/// vertices read so far.
+inline std::uint32_t vertex_index(TextParser const &parser,
+                                  std::string_view token,
+                                  std::size_t vertex_count) {
+    long long index = 0;
+    auto const result =
+        std::from_chars(token.data(), token.data() + token.size(), index);
+    if (result.ec != std::errc() ||
+        (result.ptr != token.data() + token.size() && *result.ptr != '/')) {
+        parser.fail("expected a vertex reference, got '" + std::string(token) +
+                    "'");
+    }
+    if (index < 0) {
+        index += static_cast<long long>(vertex_count);
+    } else {
+        index -= 1;
+    }
+    if (index < 0 || index >= static_cast<long long>(vertex_count)) {
+        parser.fail("vertex index out of range");
+    }
+    return std::uint32_t(index);
+}
+
+} // namespace obj_loader_detail
+
+inline TriangleMesh load_obj(std::string const &path) {
+    using namespace obj_loader_detail;
+    MappedFile const file(path);
+    TextParser parser(file.data(), file.data() + file.size(), path);
+    TriangleMesh mesh;
+    while (parser.next_line()) {
+        std::string_view const statement = parser.token();
+        if (statement == "v") {
+            // An optional fourth, homogeneous coordinate is ignored.
+            mesh.positions.push_back(parser.vector());
+        } else if (statement == "f") {
+            std::size_t const vertex_count = mesh.positions.size();
+            std::string_view token = parser.token();
+            if (token.empty()) {
+                parser.fail("face without vertices");
+            }
+            std::uint32_t const first =
+                vertex_index(parser, token, vertex_count);
+            std::uint32_t previous = first;
+            int corners = 1;
+            while (!(token = parser.token()).empty()) {
+                std::uint32_t const current =
+                    vertex_index(parser, token, vertex_count);
+                if (++corners >= 3) {
+                    mesh.indices.push_back(first);
+                    mesh.indices.push_back(previous);
+                    mesh.indices.push_back(current);
+                }
+                previous = current;
+            }
+            if (corners < 3) {
+                parser.fail("face with fewer than three vertices");
+            }
+        }
+    }
+    // Drop the slack of the growing arrays, which matters for large models.
+    mesh.positions.shrink_to_fit();
+    mesh.indices.shrink_to_fit();
+    return mesh;
+}
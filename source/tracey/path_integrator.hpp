@@ -0,0 +1,78 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "integrator.hpp"
+#include "material.hpp"
+#include "render_stats.hpp"
+#include "sampling.hpp"
+#include "tile_renderer.hpp"
+
+// Color function, which given a ray and an "world" returns the color which
+// would be seen by the given ray. The path is followed iteratively, carrying
+// its throughput, until it escapes to the sky, is absorbed or is terminated by
+// Russian roulette.
+template <typename World>
+Vector3 scene_color(Ray const &r, World const &world, Sampler &sampler) {
+    Ray ray = r;
+    Vector3 throughput(1.0f, 1.0f, 1.0f);
+    for (int depth = 0;; ++depth) {
+        HitRecord record;
+        TRACEY_STAT(thread_stats().add_ray(depth);)
+        if (!world.hit(ray, 0.001f, std::numeric_limits<float>::max(),
+                       record)) {
+            TRACEY_STAT(thread_stats().add_path(depth);)
+            return throughput * sky_color(ray);
+        }
+        Ray scattered;
+        Vector3 attenuation;
+        if (depth >= max_depth ||
+            !scatter(world, ray, record, attenuation, scattered, sampler)) {
+            TRACEY_STAT(thread_stats().add_path(depth);)
+            return Vector3(0.0f, 0.0f, 0.0f);
+        }
+        TRACEY_STAT(thread_stats().add_scatter(material_type(world, record));)
+        throughput *= attenuation;
+        if (!russian_roulette(throughput, depth + 1, sampler)) {
+            TRACEY_STAT(thread_stats().add_path(depth);)
+            return Vector3(0.0f, 0.0f, 0.0f);
+        }
+        ray = scattered;
+    }
+}
+
+/// Traces one path at a time, depth first.
+class PathIntegrator {
+  public:
+    /// Trace the requested samples of the pixels in tile and add them to
+    /// accumulator, which must already be sized for the tile.
+    template <typename World>
+    void render_tile(Tile const &tile, Camera const &cam, World const &world,
+                     RenderSettings const &settings,
+                     SampleRequest const &request,
+                     TileAccumulator &accumulator) const {
+        int const tile_width = tile.x_end - tile.x_begin;
+        for (int j = tile.y_begin; j != tile.y_end; ++j) {
+            for (int i = tile.x_begin; i != tile.x_end; ++i) {
+                auto const pixel = std::size_t((j - tile.y_begin) * tile_width +
+                                               (i - tile.x_begin));
+                if (!request.is_active(pixel)) {
+                    continue;
+                }
+                for (int s = request.begin; s != request.end;
+                     ++s) { // Take several random samples for the pixel
+                    Sampler sampler = pixel_sampler(settings, i, j, s);
+                    auto const [du, dv] = sampler.next_2d();
+                    auto u = (float(i) + du) / float(settings.width);
+                    auto v = (float(j) + dv) / float(settings.height);
+                    // For the given camera ray,
+                    accumulator.add(
+                        pixel, scene_color(cam.get_ray(u, v), world, sampler));
+                }
+            }
+        }
+    }
+};
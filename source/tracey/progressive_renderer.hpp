@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "film.hpp"
+#include "integrator.hpp"
+#include "tile_renderer.hpp"
+
+/// Controls of the progressive renderer.
+struct ProgressiveSettings {
+    /// Samples added to every unconverged pixel per pass.
+    int samples_per_pass = 4;
+    /// If larger than samples_per_pass, the samples per pass double after
+    /// every pass up to this many: small first passes give a quick first
+    /// look, larger later ones keep the overhead per pass low.
+    int max_samples_per_pass = 0;
+    /// Samples a pixel takes before it is tested for convergence.
+    int min_samples = 8;
+    /// A pixel has converged once the standard error of its mean luminance
+    /// drops below noise_threshold times that mean (floored at
+    /// min_luminance, so that dark pixels do not sample forever). Zero gives
+    /// every pixel the full sample budget.
+    float noise_threshold = 0.0f;
+    float min_luminance = 0.05f;
+    /// Wall clock budget in seconds, checked between passes; zero means none.
+    double time_budget = 0.0;
+};
+
+/// Renders an image in passes, accumulating the samples of every pixel along
+/// with their variance and retiring pixels once they have converged. The
+/// sample budget per pixel is RenderSettings::samples. Pixel samples are
+/// seeded by their index, so a pixel which never converges ends up with
+/// exactly the same value as in a single pass render.
+class ProgressiveRenderer {
+  public:
+    ProgressiveRenderer(TileRenderer const &tiles,
+                        RenderSettings const &settings,
+                        ProgressiveSettings const &progressive);
+
+    /// Render the next pass. integrate(tile, request, accumulator) has to
+    /// trace the requested samples of a tile, like the render_tile() methods
+    /// of the integrators. Returns false once rendering has finished.
+    template <typename IntegrateFunction>
+    bool render_pass(IntegrateFunction &&integrate);
+
+    /// Render passes until finished, calling on_pass(*this) after each.
+    template <typename IntegrateFunction, typename PassFunction>
+    void render(IntegrateFunction &&integrate, PassFunction &&on_pass);
+
+    bool finished() const;
+
+    /// Mean of the samples of pixel (i, j) so far.
+    Vector3 color(int i, int j) const {
+        std::size_t const p = index(i, j);
+        return samples[p] == 0 ? Vector3(0.0f, 0.0f, 0.0f)
+                               : sum.at(i, j) / float(samples[p]);
+    }
+    int sample_count(int i, int j) const { return samples[index(i, j)]; }
+
+    /// Resolve the image so far to 8 bit RGB, see Film::resolve().
+    void resolve(std::vector<std::uint8_t> &rgb) const {
+        sum.resolve(rgb, [this](int i, int j) { return sample_count(i, j); });
+    }
+
+    /// Pixels which are still being sampled.
+    std::size_t active_pixels() const { return active_count; }
+    /// Samples taken over all pixels so far.
+    std::uint64_t total_samples() const { return samples_taken; }
+    int passes() const { return pass_count; }
+
+    RenderSettings const &render_settings() const { return settings; }
+
+  private:
+    std::size_t index(int i, int j) const {
+        return std::size_t(j) * std::size_t(settings.width) + std::size_t(i);
+    }
+    bool converged(std::size_t p) const;
+
+    TileRenderer const &tiles;
+    RenderSettings settings;
+    ProgressiveSettings progressive;
+    Film sum;
+    std::vector<float> sum_squares;
+    std::vector<int> samples;
+    std::vector<std::uint8_t> active;
+    std::size_t active_count;
+    std::uint64_t samples_taken = 0;
+    int next_sample = 0;
+    int pass_count = 0;
+    std::chrono::steady_clock::time_point start;
+    bool out_of_time = false;
+};
+
+inline ProgressiveRenderer::ProgressiveRenderer(
+    TileRenderer const &tiles, RenderSettings const &settings,
+    ProgressiveSettings const &progressive)
+    : tiles(tiles), settings(settings), progressive(progressive),
+      sum(settings.width, settings.height),
+      sum_squares(std::size_t(settings.width) * std::size_t(settings.height),
+                  0.0f),
+      samples(sum_squares.size(), 0), active(sum_squares.size(), 1),
+      active_count(sum_squares.size()),
+      start(std::chrono::steady_clock::now()) {
+    this->progressive.samples_per_pass =
+        std::max(1, progressive.samples_per_pass);
+}
+
+inline bool ProgressiveRenderer::finished() const {
+    return active_count == 0 || next_sample >= settings.samples ||
+           out_of_time;
+}
+
+inline bool ProgressiveRenderer::converged(std::size_t p) const {
+    int const n = samples[p];
+    if (progressive.noise_threshold <= 0.0f ||
+        n < std::max(2, progressive.min_samples)) {
+        return false;
+    }
+    float const mean = luminance(sum.data()[p]) / float(n);
+    float const variance =
+        std::max(0.0f, (sum_squares[p] - float(n) * mean * mean) /
+                           float(n - 1));
+    float const standard_error = std::sqrt(variance / float(n));
+    return standard_error <= progressive.noise_threshold *
+                                 std::max(mean, progressive.min_luminance);
+}
+
+template <typename IntegrateFunction>
+bool ProgressiveRenderer::render_pass(IntegrateFunction &&integrate) {
+    if (finished()) {
+        return false;
+    }
+    // Every active pixel has taken the same samples so far, so one sample
+    // range serves the whole pass.
+    SampleRequest const range{
+        next_sample, std::min(settings.samples,
+                              next_sample + progressive.samples_per_pass)};
+    std::atomic<std::uint64_t> pass_samples{0};
+    tiles.render(settings.width, settings.height, [&](Tile const &tile,
+                                                      std::size_t) {
+        // Continue from the sums so far, so that every pixel adds up its
+        // samples in the same order as a single pass render would.
+        std::vector<std::uint8_t> tile_active;
+        TileAccumulator accumulator;
+        std::size_t tile_active_count = 0;
+        for (int j = tile.y_begin; j != tile.y_end; ++j) {
+            for (int i = tile.x_begin; i != tile.x_end; ++i) {
+                std::size_t const p = index(i, j);
+                tile_active.push_back(active[p]);
+                accumulator.sum.push_back(sum.at(i, j));
+                accumulator.sum_squares.push_back(sum_squares[p]);
+                tile_active_count += active[p];
+            }
+        }
+        if (tile_active_count == 0) {
+            return;
+        }
+        SampleRequest request = range;
+        request.active = &tile_active;
+        integrate(tile, request, accumulator);
+        std::size_t t = 0;
+        for (int j = tile.y_begin; j != tile.y_end; ++j) {
+            for (int i = tile.x_begin; i != tile.x_end; ++i, ++t) {
+                if (!tile_active[t]) {
+                    continue;
+                }
+                std::size_t const p = index(i, j);
+                sum.at(i, j) = accumulator.sum[t];
+                sum_squares[p] = accumulator.sum_squares[t];
+                samples[p] += range.end - range.begin;
+            }
+        }
+        pass_samples +=
+            tile_active_count * std::uint64_t(range.end - range.begin);
+    });
+    samples_taken += pass_samples;
+    next_sample = range.end;
+    ++pass_count;
+    progressive.samples_per_pass =
+        std::max(progressive.samples_per_pass,
+                 std::min(2 * progressive.samples_per_pass,
+                          progressive.max_samples_per_pass));
+    // Retire converged pixels.
+    for (std::size_t p = 0; p != active.size(); ++p) {
+        if (active[p] && converged(p)) {
+            active[p] = 0;
+            --active_count;
+        }
+    }
+    if (progressive.time_budget > 0.0) {
+        std::chrono::duration<double> const elapsed =
+            std::chrono::steady_clock::now() - start;
+        out_of_time = elapsed.count() >= progressive.time_budget;
+    }
+    return true;
+}
+
+template <typename IntegrateFunction, typename PassFunction>
+void ProgressiveRenderer::render(IntegrateFunction &&integrate,
+                                 PassFunction &&on_pass) {
+    while (render_pass(integrate)) {
+        on_pass(*this);
+    }
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+// Rendering an image in parts, e.g. in several processes or on several
+// machines, and merging the parts again. A part is a range of samples of
+// every pixel in a region of the image. Its film of summed samples is saved
+// as a partial image file:
+//
+//   char     magic[8]          "TRACEYPI"
+//   uint32   version           2
+//   int32    width, height     of the whole image
+//   uint64   seed
+//   int32    samples           per pixel of the whole image
+//   int32    sampler           SampleSequence
+//   int32    integrator        0 path, 1 wavefront
+//   int32    max_depth
+//   uint64   scene             hash of the scene, see scene_hash()
+//   int32    region[4]         x_begin, y_begin, x_end, y_end
+//   int32    sample_begin, sample_end
+//   float    rgb[3] per pixel of the region, rows from y_begin up
+//
+// all little endian and, like binary scene files, read and written in host
+// byte order, so only on little endian hosts. As every pixel sample has its
+// own random sequence, parts split by rows hold exactly the sums a single
+// process computes, and merging them reproduces its image bit for bit. Parts
+// split by samples are summed in order of their sample ranges, so the result
+// depends on the split but never on the order in which parts finish or are
+// listed. Parts merge only if everything that decides their samples, from the
+// image size to the scene, is the same.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "file_input.hpp"
+#include "film.hpp"
+#include "tile_renderer.hpp"
+
+/// How an image is divided into parts.
+enum class PartSplit {
+    /// Bands of rows with all samples.
+    rows,
+    /// Ranges of samples of all pixels.
+    samples
+};
+
+/// Samples [sample_begin, sample_end) of every pixel in region.
+struct RenderPart {
+    Tile region;
+    int sample_begin;
+    int sample_end;
+};
+
+/// Part index of count equal parts of a width times height image with the
+/// given samples per pixel. Parts split by rows are ordered top down.
+inline RenderPart render_part(int width, int height, int samples,
+                              PartSplit split, int index, int count);
+
+/// The summed samples of a part of an image.
+struct PartialImage {
+    int width = 0;
+    int height = 0;
+    std::uint64_t seed = 0;
+    /// Samples per pixel of the whole image.
+    int samples = 0;
+    int sampler = 0;
+    int integrator = 0;
+    int max_depth = 0;
+    std::uint64_t scene = 0;
+    RenderPart part{{0, 0, 0, 0}, 0, 0};
+    /// Covers part.region.
+    Film film;
+};
+
+/// Write a partial image. Throws std::runtime_error on failure.
+inline void save_partial_image(std::string const &path,
+                               PartialImage const &image);
+
+/// Read a partial image, or only its header if with_film is false. Throws
+/// std::runtime_error on malformed files.
+inline PartialImage load_partial_image(std::string const &path,
+                                       bool with_film = true);
+
+/// The merged image: the sums of all samples and their number per pixel.
+struct MergedImage {
+    Film film;
+    int samples = 0;
+};
+
+/// Merge partial image files into the whole image, loading one part at a
+/// time. Throws std::runtime_error unless the parts belong to the same image,
+/// rendered with the same seed, settings and scene, and together hold all
+/// its samples of every pixel.
+inline MergedImage merge_partial_images(std::vector<std::string> const &paths);
+
+namespace render_parts_detail {
+
+static_assert(host_little_endian,
+              "partial images are little endian, in host byte order");
+
+constexpr char const magic[8] = {'T', 'R', 'A', 'C', 'E', 'Y', 'P', 'I'};
+constexpr std::uint32_t const version = 2;
+constexpr std::size_t const header_size =
+    8 + 4 + 2 * 4 + 8 + 4 * 4 + 8 + 4 * 4 + 2 * 4;
+
+/// Whether two parts were rendered with the same settings.
+inline bool same_settings(PartialImage const &a, PartialImage const &b) {
+    return a.width == b.width && a.height == b.height && a.seed == b.seed &&
+           a.samples == b.samples && a.sampler == b.sampler &&
+           a.integrator == b.integrator && a.max_depth == b.max_depth &&
+           a.scene == b.scene;
+}
+
+template <typename T> T read(char const *&data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+template <typename T> void write(std::ostream &out, T const &value) {
+    out.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+/// Whether two parts contribute the same sample to some pixel.
+inline bool overlap(RenderPart const &a, RenderPart const &b) {
+    return a.region.x_begin < b.region.x_end &&
+           b.region.x_begin < a.region.x_end &&
+           a.region.y_begin < b.region.y_end &&
+           b.region.y_begin < a.region.y_end &&
+           a.sample_begin < b.sample_end && b.sample_begin < a.sample_end;
+}
+
+} // namespace render_parts_detail
+
+inline RenderPart render_part(int width, int height, int samples,
+                              PartSplit split, int index, int count) {
+    auto const boundary = [index, count](int total, int k) {
+        return int(std::int64_t(total) * k / count);
+    };
+    if (split == PartSplit::samples) {
+        return RenderPart{Tile{0, 0, width, height},
+                          boundary(samples, index),
+                          boundary(samples, index + 1)};
+    }
+    // Row 0 is the bottom row; number the bands from the top.
+    return RenderPart{Tile{0, height - boundary(height, index + 1), width,
+                           height - boundary(height, index)},
+                      0, samples};
+}
+
+inline void save_partial_image(std::string const &path,
+                               PartialImage const &image) {
+    using namespace render_parts_detail;
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error(path + ": unable to open file");
+    }
+    Tile const &r = image.part.region;
+    out.write(magic, sizeof(magic));
+    write(out, version);
+    write(out, std::int32_t(image.width));
+    write(out, std::int32_t(image.height));
+    write(out, image.seed);
+    for (int v : {image.samples, image.sampler, image.integrator,
+                  image.max_depth}) {
+        write(out, std::int32_t(v));
+    }
+    write(out, image.scene);
+    for (int v : {r.x_begin, r.y_begin, r.x_end, r.y_end,
+                  image.part.sample_begin, image.part.sample_end}) {
+        write(out, std::int32_t(v));
+    }
+    std::vector<float> row;
+    for (int j = r.y_begin; j != r.y_end; ++j) {
+        row.clear();
+        for (int i = r.x_begin; i != r.x_end; ++i) {
+            Color const &c = image.film.at(i, j);
+            row.insert(row.end(), {c.r(), c.g(), c.b()});
+        }
+        out.write(reinterpret_cast<char const *>(row.data()),
+                  std::streamsize(row.size() * sizeof(float)));
+    }
+    if (!out) {
+        throw std::runtime_error(path + ": unable to write file");
+    }
+}
+
+inline PartialImage load_partial_image(std::string const &path,
+                                       bool with_film) {
+    using namespace render_parts_detail;
+    auto const fail = [&](char const *message) {
+        throw std::runtime_error(path + ": " + message);
+    };
+    MappedFile const file(path);
+    char const *data = file.data();
+    if (file.size() < header_size ||
+        std::memcmp(data, magic, sizeof(magic)) != 0) {
+        fail("not a partial image");
+    }
+    data += sizeof(magic);
+    if (read<std::uint32_t>(data) != version) {
+        fail("unsupported version");
+    }
+    PartialImage image;
+    image.width = read<std::int32_t>(data);
+    image.height = read<std::int32_t>(data);
+    image.seed = read<std::uint64_t>(data);
+    image.samples = read<std::int32_t>(data);
+    image.sampler = read<std::int32_t>(data);
+    image.integrator = read<std::int32_t>(data);
+    image.max_depth = read<std::int32_t>(data);
+    image.scene = read<std::uint64_t>(data);
+    Tile &r = image.part.region;
+    r.x_begin = read<std::int32_t>(data);
+    r.y_begin = read<std::int32_t>(data);
+    r.x_end = read<std::int32_t>(data);
+    r.y_end = read<std::int32_t>(data);
+    image.part.sample_begin = read<std::int32_t>(data);
+    image.part.sample_end = read<std::int32_t>(data);
+    if (r.x_begin < 0 || r.y_begin < 0 || r.x_begin > r.x_end ||
+        r.y_begin > r.y_end || r.x_end > image.width ||
+        r.y_end > image.height || image.part.sample_begin < 0 ||
+        image.part.sample_begin > image.part.sample_end ||
+        image.part.sample_end > image.samples) {
+        fail("invalid part");
+    }
+    std::size_t const pixels =
+        std::size_t(r.x_end - r.x_begin) * std::size_t(r.y_end - r.y_begin);
+    if (file.size() != header_size + 3 * sizeof(float) * pixels) {
+        fail("size does not match the header");
+    }
+    if (with_film) {
+        image.film.resize(r);
+        for (int j = r.y_begin; j != r.y_end; ++j) {
+            for (int i = r.x_begin; i != r.x_end; ++i) {
+                float const red = read<float>(data);
+                float const green = read<float>(data);
+                float const blue = read<float>(data);
+                image.film.at(i, j) = Color(red, green, blue);
+            }
+        }
+    }
+    return image;
+}
+
+inline MergedImage
+merge_partial_images(std::vector<std::string> const &paths) {
+    using namespace render_parts_detail;
+    if (paths.empty()) {
+        throw std::runtime_error("no partial images to merge");
+    }
+    struct Header {
+        PartialImage image;
+        std::string const *path;
+    };
+    std::vector<Header> headers;
+    for (auto const &path : paths) {
+        headers.push_back(Header{load_partial_image(path, false), &path});
+    }
+    // A fixed summation order makes the result independent of the order of
+    // the files.
+    std::sort(headers.begin(), headers.end(),
+              [](Header const &a, Header const &b) {
+                  RenderPart const &p = a.image.part;
+                  RenderPart const &q = b.image.part;
+                  if (p.sample_begin != q.sample_begin) {
+                      return p.sample_begin < q.sample_begin;
+                  }
+                  if (p.region.y_begin != q.region.y_begin) {
+                      return p.region.y_begin < q.region.y_begin;
+                  }
+                  return p.region.x_begin < q.region.x_begin;
+              });
+    PartialImage const &first = headers.front().image;
+    for (std::size_t a = 0; a != headers.size(); ++a) {
+        PartialImage const &image = headers[a].image;
+        if (!same_settings(image, first)) {
+            throw std::runtime_error(*headers[a].path +
+                                     ": part of a different image or "
+                                     "rendered with different settings");
+        }
+        for (std::size_t b = 0; b != a; ++b) {
+            if (overlap(image.part, headers[b].image.part)) {
+                throw std::runtime_error(*headers[a].path + ": overlaps " +
+                                         *headers[b].path);
+            }
+        }
+    }
+    MergedImage merged;
+    merged.film.resize(first.width, first.height);
+    // Samples per pixel; as no parts overlap and none goes beyond n, a pixel
+    // has all samples [0, n) if it has n of them.
+    std::vector<int> samples(std::size_t(first.width) *
+                             std::size_t(first.height));
+    merged.samples = first.samples;
+    for (auto const &header : headers) {
+        PartialImage const image = load_partial_image(*header.path);
+        Tile const &r = image.part.region;
+        int const n = image.part.sample_end - image.part.sample_begin;
+        for (int j = r.y_begin; j != r.y_end; ++j) {
+            for (int i = r.x_begin; i != r.x_end; ++i) {
+                merged.film.accumulate(i, j, image.film.at(i, j));
+                samples[std::size_t(j) * std::size_t(first.width) +
+                        std::size_t(i)] += n;
+            }
+        }
+    }
+    for (int n : samples) {
+        if (n != merged.samples) {
+            throw std::runtime_error("the parts do not cover every pixel with "
+                                     "the same samples");
+        }
+    }
+    return merged;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+// Render statistics. Counting is compiled in only when TRACEY_STATS is
+// defined to 1 (the CMake option of the same name); otherwise TRACEY_STAT()
+// expands to nothing and the hot paths are unchanged.
+
+#ifndef TRACEY_STATS
+#define TRACEY_STATS 0
+#endif
+
+#if TRACEY_STATS
+#define TRACEY_STAT(...) __VA_ARGS__
+#else
+#define TRACEY_STAT(...)
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "material.hpp"
+
+/// Number of bins of the path depth histogram; the last bin also counts all
+/// deeper paths.
+constexpr std::size_t const depth_bins = 32;
+
+/// Totals of the render statistics.
+struct RenderStats {
+    /// Camera rays, one per pixel sample.
+    std::uint64_t primary_rays = 0;
+    /// Rays traced after a scattering event.
+    std::uint64_t secondary_rays = 0;
+    /// Ray-primitive intersection tests.
+    std::uint64_t intersection_tests = 0;
+    /// Acceleration structure nodes visited.
+    std::uint64_t nodes_visited = 0;
+    /// Scattering events by MaterialType.
+    std::uint64_t scatters[3] = {0, 0, 0};
+    /// Number of paths ending after a given number of bounces.
+    std::uint64_t path_depths[depth_bins] = {};
+    std::uint64_t tiles = 0;
+    std::uint64_t tile_nanoseconds = 0;
+    std::uint64_t max_tile_nanoseconds = 0;
+
+    std::uint64_t rays() const { return primary_rays + secondary_rays; }
+
+    RenderStats &operator+=(RenderStats const &other);
+};
+
+inline RenderStats &RenderStats::operator+=(RenderStats const &other) {
+    primary_rays += other.primary_rays;
+    secondary_rays += other.secondary_rays;
+    intersection_tests += other.intersection_tests;
+    nodes_visited += other.nodes_visited;
+    for (std::size_t i = 0; i != 3; ++i) {
+        scatters[i] += other.scatters[i];
+    }
+    for (std::size_t i = 0; i != depth_bins; ++i) {
+        path_depths[i] += other.path_depths[i];
+    }
+    tiles += other.tiles;
+    tile_nanoseconds += other.tile_nanoseconds;
+    max_tile_nanoseconds =
+        std::max(max_tile_nanoseconds, other.max_tile_nanoseconds);
+    return *this;
+}
+
+/// Counter written by one thread and read by any. Increments are a plain
+/// load and store rather than an atomic read-modify-write, which is enough
+/// with a single writer and keeps counting cheap.
+class StatCounter {
+  public:
+    void add(std::uint64_t n = 1) {
+        value.store(value.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+    void set_max(std::uint64_t n) {
+        if (n > value.load(std::memory_order_relaxed)) {
+            value.store(n, std::memory_order_relaxed);
+        }
+    }
+    std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    void reset() { value.store(0, std::memory_order_relaxed); }
+
+  private:
+    std::atomic<std::uint64_t> value{0};
+};
+
+/// The counters of one thread, mirroring RenderStats.
+struct ThreadStats {
+    StatCounter primary_rays;
+    StatCounter secondary_rays;
+    StatCounter intersection_tests;
+    StatCounter nodes_visited;
+    StatCounter scatters[3];
+    StatCounter path_depths[depth_bins];
+    StatCounter tiles;
+    StatCounter tile_nanoseconds;
+    StatCounter max_tile_nanoseconds;
+
+    void add_to(RenderStats &stats) const;
+    void reset();
+
+    /// Count a ray leaving the camera (depth 0) or a surface.
+    void add_ray(int depth) {
+        (depth == 0 ? primary_rays : secondary_rays).add();
+    }
+    void add_scatter(MaterialType type) { scatters[int(type)].add(); }
+    /// Count a path ending after the given number of bounces.
+    void add_path(int bounces) {
+        path_depths[std::min(std::size_t(bounces), depth_bins - 1)].add();
+    }
+    void add_tile(std::uint64_t nanoseconds) {
+        tiles.add();
+        tile_nanoseconds.add(nanoseconds);
+        max_tile_nanoseconds.set_max(nanoseconds);
+    }
+};
+
+inline void ThreadStats::add_to(RenderStats &stats) const {
+    RenderStats own;
+    own.primary_rays = primary_rays.get();
+    own.secondary_rays = secondary_rays.get();
+    own.intersection_tests = intersection_tests.get();
+    own.nodes_visited = nodes_visited.get();
+    for (std::size_t i = 0; i != 3; ++i) {
+        own.scatters[i] = scatters[i].get();
+    }
+    for (std::size_t i = 0; i != depth_bins; ++i) {
+        own.path_depths[i] = path_depths[i].get();
+    }
+    own.tiles = tiles.get();
+    own.tile_nanoseconds = tile_nanoseconds.get();
+    own.max_tile_nanoseconds = max_tile_nanoseconds.get();
+    stats += own;
+}
+
+inline void ThreadStats::reset() {
+    for (StatCounter *c : {&primary_rays, &secondary_rays, &intersection_tests,
+                           &nodes_visited, &tiles, &tile_nanoseconds,
+                           &max_tile_nanoseconds}) {
+        c->reset();
+    }
+    for (auto &c : scatters) {
+        c.reset();
+    }
+    for (auto &c : path_depths) {
+        c.reset();
+    }
+}
+
+/// All threads' counters. Every thread counts into its own ThreadStats, which
+/// stays registered after the thread exits, so totals are never lost.
+class StatsRegistry {
+  public:
+    /// The counters of the calling thread.
+    static ThreadStats &local() {
+        thread_local ThreadStats &stats = instance().add_thread();
+        return stats;
+    }
+
+    /// Totals over all threads so far. May be called while rendering.
+    static RenderStats collect() {
+        StatsRegistry &registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        RenderStats total;
+        for (auto const &stats : registry.threads) {
+            stats->add_to(total);
+        }
+        return total;
+    }
+
+    /// Zero all counters; only call while no thread is counting.
+    static void reset() {
+        StatsRegistry &registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto const &stats : registry.threads) {
+            stats->reset();
+        }
+    }
+
+  private:
+    static StatsRegistry &instance() {
+        static StatsRegistry registry;
+        return registry;
+    }
+
+    ThreadStats &add_thread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(std::make_unique<ThreadStats>());
+        return *threads.back();
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadStats>> threads;
+};
+
+/// Counters of the calling thread, for use inside TRACEY_STAT().
+inline ThreadStats &thread_stats() { return StatsRegistry::local(); }
+
+/// Write stats as a single line JSON object. pixels and samples are those of
+/// the images rendered so far, which can differ from the primary rays, e.g.
+/// for previews, and seconds the wall clock time taken, for the derived
+/// rates.
+inline void write_json(std::ostream &out, RenderStats const &stats,
+                       std::uint64_t pixels, std::uint64_t samples,
+                       double seconds) {
+    auto const ratio = [](double a, double b) { return b > 0.0 ? a / b : 0.0; };
+    double const rays = double(stats.rays());
+    out << "{\"elapsed_seconds\":" << seconds
+        << ",\"primary_rays\":" << stats.primary_rays
+        << ",\"secondary_rays\":" << stats.secondary_rays
+        << ",\"rays_per_second\":" << ratio(rays, seconds)
+        << ",\"intersection_tests\":" << stats.intersection_tests
+        << ",\"intersection_tests_per_ray\":"
+        << ratio(double(stats.intersection_tests), rays)
+        << ",\"nodes_visited_per_ray\":"
+        << ratio(double(stats.nodes_visited), rays)
+        << ",\"scatters\":{\"lambertian\":"
+        << stats.scatters[int(MaterialType::lambertian)]
+        << ",\"metal\":" << stats.scatters[int(MaterialType::metal)]
+        << ",\"other\":" << stats.scatters[int(MaterialType::other)] << '}'
+        << ",\"path_depth_histogram\":[";
+    for (std::size_t i = 0; i != depth_bins; ++i) {
+        out << (i == 0 ? "" : ",") << stats.path_depths[i];
+    }
+    out << "],\"samples\":" << samples << ",\"samples_per_pixel\":"
+        << ratio(double(samples), double(pixels))
+        << ",\"tiles\":" << stats.tiles << ",\"tile_milliseconds\":{\"mean\":"
+        << ratio(1e-6 * double(stats.tile_nanoseconds), double(stats.tiles))
+        << ",\"max\":" << 1e-6 * double(stats.max_tile_nanoseconds)
+        << ",\"total\":" << 1e-6 * double(stats.tile_nanoseconds) << "}}";
+}
@@ -0,0 +1,390 @@
+#pragma once
+
+// Scene files in two flavours holding the same content: a camera, materials
+// and spheres, plus triangle meshes in text scene files.
+//
+// The text format has one statement per line, '#' starting a comment:
+//
+//   camera <lookfrom x y z> <lookat x y z> <up x y z> <vertical fov degrees>
+//   material <name> lambertian <albedo r g b>
+//   material <name> metal <albedo r g b>
+//   sphere <center x y z> <radius> <material name>
+//   mesh <OBJ file> <material name>
+//
+// Materials have to be defined before the spheres and meshes using them.
+// Relative OBJ file names are relative to the directory of the scene file, and
+// saving a scene writes them relative to the directory of the new file.
+// The binary format has no meshes.
+//
+// The binary format is a fixed header followed by arrays of fixed size
+// records, all little endian, which the loader memory maps and decodes in a
+// single pass. Values are read and written in host byte order, so only little
+// endian hosts are supported:
+//
+//   char     magic[8]          "TRACEYSC"
+//   uint32   version           1
+//   uint32   material_count
+//   uint64   sphere_count
+//   float    camera[10]        lookfrom, lookat, up, vertical fov
+//   material_count times:      uint32 type (0 lambertian, 1 metal),
+//                              float albedo[3]
+//   sphere_count times:        float center[3], float radius,
+//                              uint32 material index
+//
+// Either way the scene loads into a StaticScene, which stores spheres and
+// materials by value in contiguous arrays.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "camera.hpp"
+#include "file_input.hpp"
+#include "lambertian.hpp"
+#include "metal.hpp"
+#include "obj_loader.hpp"
+#include "static_scene.hpp"
+#include "vector3.hpp"
+
+/// Placement of the camera of a scene; the aspect ratio comes from the image.
+struct CameraSettings {
+    Vector3 lookfrom;
+    Vector3 lookat;
+    Vector3 up;
+    float vfov;
+
+    Camera camera(float aspect) const {
+        return Camera(lookfrom, lookat, up, vfov, aspect);
+    }
+};
+
+/// A scene as stored in a scene file. The world still has to be built.
+struct SceneDescription {
+    CameraSettings camera{Vector3(0, 0, 0), Vector3(0, 0, -1),
+                          Vector3(0, 1, 0), 90.0f};
+    StaticScene world;
+    /// OBJ file of every mesh of the world, relative ones resolved against
+    /// the directory of the scene file.
+    std::vector<std::string> mesh_files;
+};
+
+/// Load a text or binary scene file, telling them apart by the binary magic.
+/// Throws std::runtime_error on malformed files.
+inline SceneDescription load_scene(std::string const &path);
+
+/// Write a scene as text.
+inline void save_scene_text(std::string const &path,
+                            SceneDescription const &scene);
+
+/// Write a scene in the binary format. Throws std::runtime_error for scenes
+/// with meshes.
+inline void save_scene_binary(std::string const &path,
+                              SceneDescription const &scene);
+
+/// 64 bit hash of the content of a scene, which tells apart scenes rendering
+/// differently: camera, materials, spheres and meshes, in the order loaded.
+/// The world must not have been built yet.
+inline std::uint64_t scene_hash(SceneDescription const &scene);
+
+namespace scene_file_detail {
+
+/// FNV-1a hash over the bytes of values.
+class Fnv1a {
+  public:
+    template <typename T> void add(T const &value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (unsigned char byte : bytes) {
+            state = (state ^ byte) * 0x100000001b3u;
+        }
+    }
+    void add(Vector3 const &v) {
+        add(v.x());
+        add(v.y());
+        add(v.z());
+    }
+    std::uint64_t value() const { return state; }
+
+  private:
+    std::uint64_t state = 0xcbf29ce484222325u;
+};
+
+static_assert(host_little_endian,
+              "binary scene files are little endian, in host byte order");
+
+constexpr char const binary_magic[8] = {'T', 'R', 'A', 'C',
+                                        'E', 'Y', 'S', 'C'};
+constexpr std::uint32_t const binary_version = 1;
+constexpr std::size_t const binary_header_size = 8 + 4 + 4 + 8 + 10 * 4;
+constexpr std::size_t const binary_material_size = 4 + 3 * 4;
+constexpr std::size_t const binary_sphere_size = 4 * 4 + 4;
+
+inline SceneDescription load_text(char const *begin, char const *end,
+                                  std::string const &path) {
+    SceneDescription scene;
+    TextParser parser(begin, end, path);
+    std::unordered_map<std::string, std::uint32_t> materials;
+    while (parser.next_line()) {
+        std::string_view const statement = parser.token();
+        if (statement == "sphere") {
+            Vector3 const center = parser.vector();
+            float const radius = parser.number();
+            auto const found = materials.find(std::string(parser.token()));
+            if (found == materials.end()) {
+                parser.fail("unknown material");
+            }
+            scene.world.add_sphere(center, radius, found->second);
+        } else if (statement == "mesh") {
+            std::string file(parser.token());
+            auto const found = materials.find(std::string(parser.token()));
+            if (file.empty() || found == materials.end()) {
+                parser.fail("expected an OBJ file and a known material");
+            }
+            std::filesystem::path obj_path(file);
+            if (obj_path.is_relative()) {
+                obj_path = std::filesystem::path(path).parent_path() / obj_path;
+            }
+            scene.world.add_mesh(load_obj(obj_path.string()), found->second);
+            scene.mesh_files.push_back(obj_path.string());
+        } else if (statement == "material") {
+            std::string name(parser.token());
+            std::string_view const type = parser.token();
+            if (name.empty()) {
+                parser.fail("expected a material name");
+            }
+            Vector3 const albedo = parser.vector();
+            std::uint32_t index;
+            if (type == "lambertian") {
+                index = scene.world.add_material(Lambertian(albedo));
+            } else if (type == "metal") {
+                index = scene.world.add_material(Metal(albedo));
+            } else {
+                parser.fail("unknown material type '" + std::string(type) +
+                            "'");
+            }
+            if (!materials.emplace(std::move(name), index).second) {
+                parser.fail("material defined twice");
+            }
+        } else if (statement == "camera") {
+            scene.camera.lookfrom = parser.vector();
+            scene.camera.lookat = parser.vector();
+            scene.camera.up = parser.vector();
+            scene.camera.vfov = parser.number();
+        } else {
+            parser.fail("unknown statement '" + std::string(statement) + "'");
+        }
+        parser.expect_end();
+    }
+    return scene;
+}
+
+template <typename T> T read_binary(char const *&data) {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+template <typename T> void write_binary(std::ostream &out, T const &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    out.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+inline Vector3 read_binary_vector(char const *&data) {
+    float const x = read_binary<float>(data);
+    float const y = read_binary<float>(data);
+    float const z = read_binary<float>(data);
+    return Vector3(x, y, z);
+}
+
+inline void write_binary_vector(std::ostream &out, Vector3 const &v) {
+    write_binary(out, v.x());
+    write_binary(out, v.y());
+    write_binary(out, v.z());
+}
+
+inline SceneDescription load_binary(char const *data, std::size_t size,
+                                    std::string const &path) {
+    auto const fail = [&](char const *message) {
+        throw std::runtime_error(path + ": " + message);
+    };
+    if (size < binary_header_size) {
+        fail("truncated header");
+    }
+    data += sizeof(binary_magic);
+    if (read_binary<std::uint32_t>(data) != binary_version) {
+        fail("unsupported version");
+    }
+    std::uint32_t const material_count = read_binary<std::uint32_t>(data);
+    std::uint64_t const sphere_count = read_binary<std::uint64_t>(data);
+    if (sphere_count > (size - binary_header_size) / binary_sphere_size ||
+        size != binary_header_size + material_count * binary_material_size +
+                    sphere_count * binary_sphere_size) {
+        fail("size does not match the header");
+    }
+    SceneDescription scene;
+    scene.camera.lookfrom = read_binary_vector(data);
+    scene.camera.lookat = read_binary_vector(data);
+    scene.camera.up = read_binary_vector(data);
+    scene.camera.vfov = read_binary<float>(data);
+    scene.world.materials.reserve(material_count);
+    for (std::uint32_t m = 0; m != material_count; ++m) {
+        std::uint32_t const type = read_binary<std::uint32_t>(data);
+        Vector3 const albedo = read_binary_vector(data);
+        if (type == 0) {
+            scene.world.add_material(Lambertian(albedo));
+        } else if (type == 1) {
+            scene.world.add_material(Metal(albedo));
+        } else {
+            fail("unknown material type");
+        }
+    }
+    auto &spheres = scene.world.spheres;
+    spheres.resize(std::size_t(sphere_count));
+    for (auto &sphere : spheres) {
+        sphere.center = read_binary_vector(data);
+        sphere.radius = read_binary<float>(data);
+        sphere.material = read_binary<std::uint32_t>(data);
+        if (sphere.material >= material_count) {
+            fail("material index out of range");
+        }
+    }
+    return scene;
+}
+
+} // namespace scene_file_detail
+
+inline SceneDescription load_scene(std::string const &path) {
+    using namespace scene_file_detail;
+    MappedFile const file(path);
+    if (file.size() >= sizeof(binary_magic) &&
+        std::memcmp(file.data(), binary_magic, sizeof(binary_magic)) == 0) {
+        return load_binary(file.data(), file.size(), path);
+    }
+    return load_text(file.data(), file.data() + file.size(), path);
+}
+
+inline void save_scene_text(std::string const &path,
+                            SceneDescription const &scene) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw std::runtime_error(path + ": unable to open file");
+    }
+    // Enough digits for floats to survive the round trip.
+    out << std::setprecision(std::numeric_limits<float>::max_digits10);
+    CameraSettings const &c = scene.camera;
+    out << "camera " << c.lookfrom << "  " << c.lookat << "  " << c.up << "  "
+        << c.vfov << '\n';
+    for (std::size_t m = 0; m != scene.world.materials.size(); ++m) {
+        out << "material m" << m << ' ';
+        std::visit(
+            [&](auto const &material) {
+                using Type = std::decay_t<decltype(material)>;
+                out << (std::is_same<Type, Metal>::value ? "metal "
+                                                         : "lambertian ")
+                    << material.attenuation() << '\n';
+            },
+            scene.world.materials[m]);
+    }
+    for (auto const &sphere : scene.world.spheres) {
+        out << "sphere " << sphere.center << "  " << sphere.radius << " m"
+            << sphere.material << '\n';
+    }
+    std::filesystem::path const directory =
+        std::filesystem::absolute(path).parent_path();
+    for (std::size_t m = 0; m != scene.mesh_files.size(); ++m) {
+        std::filesystem::path const file = std::filesystem::proximate(
+            std::filesystem::absolute(scene.mesh_files[m]), directory);
+        out << "mesh " << file.generic_string() << " m"
+            << scene.world.mesh_materials[m] << '\n';
+    }
+    if (!out) {
+        throw std::runtime_error(path + ": unable to write file");
+    }
+}
+
+inline void save_scene_binary(std::string const &path,
+                              SceneDescription const &scene) {
+    using namespace scene_file_detail;
+    if (!scene.world.meshes.empty()) {
+        throw std::runtime_error(path + ": binary scenes cannot hold meshes");
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error(path + ": unable to open file");
+    }
+    out.write(binary_magic, sizeof(binary_magic));
+    write_binary(out, binary_version);
+    write_binary(out, std::uint32_t(scene.world.materials.size()));
+    write_binary(out, std::uint64_t(scene.world.spheres.size()));
+    write_binary_vector(out, scene.camera.lookfrom);
+    write_binary_vector(out, scene.camera.lookat);
+    write_binary_vector(out, scene.camera.up);
+    write_binary(out, scene.camera.vfov);
+    for (auto const &material : scene.world.materials) {
+        std::visit(
+            [&](auto const &m) {
+                using Type = std::decay_t<decltype(m)>;
+                bool const metal = std::is_same<Type, Metal>::value;
+                write_binary(out, std::uint32_t(metal ? 1 : 0));
+                write_binary_vector(out, m.attenuation());
+            },
+            material);
+    }
+    for (auto const &sphere : scene.world.spheres) {
+        write_binary_vector(out, sphere.center);
+        write_binary(out, sphere.radius);
+        write_binary(out, sphere.material);
+    }
+    if (!out) {
+        throw std::runtime_error(path + ": unable to write file");
+    }
+}
+
+inline std::uint64_t scene_hash(SceneDescription const &scene) {
+    scene_file_detail::Fnv1a hash;
+    hash.add(scene.camera.lookfrom);
+    hash.add(scene.camera.lookat);
+    hash.add(scene.camera.up);
+    hash.add(scene.camera.vfov);
+    StaticScene const &world = scene.world;
+    hash.add(std::uint64_t(world.materials.size()));
+    for (auto const &material : world.materials) {
+        hash.add(std::uint32_t(material.index()));
+        std::visit([&](auto const &m) { hash.add(m.attenuation()); },
+                   material);
+    }
+    hash.add(std::uint64_t(world.spheres.size()));
+    for (auto const &sphere : world.spheres) {
+        hash.add(sphere.center);
+        hash.add(sphere.radius);
+        hash.add(sphere.material);
+    }
+    hash.add(std::uint64_t(world.meshes.size()));
+    for (std::size_t m = 0; m != world.meshes.size(); ++m) {
+        TriangleMesh const &mesh = world.meshes[m];
+        hash.add(world.mesh_materials[m]);
+        hash.add(std::uint64_t(mesh.positions.size()));
+        for (auto const &position : mesh.positions) {
+            hash.add(position);
+        }
+        hash.add(std::uint64_t(mesh.indices.size()));
+        for (std::uint32_t index : mesh.indices) {
+            hash.add(index);
+        }
+    }
+    return hash.value();
+}
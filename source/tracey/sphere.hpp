@@ -1,6 +1,7 @@
 #pragma once
 
 #include "hittable.hpp"
+#include "render_stats.hpp"
 
 #include <cmath>
 
@@ -8,12 +9,16 @@ class Sphere: public Hittable  {
     public:
         Sphere(Vector3 cen, float r, Material const& mat) : center(cen), radius(r), material(&mat) {};
         virtual bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const;
+        virtual bool bounding_box(Aabb& box) const;
         Vector3 center;
         float radius;
         Material const* material;
 };
 
-bool Sphere::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
+/// Nearest intersection of a ray with a sphere within (t_min, t_max). Fills in
+/// everything in rec except the material.
+inline bool hit_sphere(Vector3 const& center, float radius, const Ray& r, float t_min, float t_max, HitRecord& rec) {
+    TRACEY_STAT(thread_stats().intersection_tests.add());
     Vector3 oc = r.origin() - center;
     float a = dot(r.direction(), r.direction());
     float b = dot(oc, r.direction());
@@ -25,7 +30,6 @@ bool Sphere::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
             rec.t = temp;
             rec.p = r.point_at_parameter(rec.t);
             rec.normal = (rec.p - center) / radius;
-            rec.material = material;
             return true;
         }
         temp = (-b + std::sqrt(discriminant)) / a;
@@ -33,9 +37,22 @@ bool Sphere::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
             rec.t = temp;
             rec.p = r.point_at_parameter(rec.t);
             rec.normal = (rec.p - center) / radius;
-            rec.material = material;
             return true;
         }
     }
     return false;
 }
+
+bool Sphere::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
+    if (hit_sphere(center, radius, r, t_min, t_max, rec)) {
+        rec.material = material;
+        return true;
+    }
+    return false;
+}
+
+bool Sphere::bounding_box(Aabb& box) const {
+    float const r = std::abs(radius);
+    box = Aabb(center - Vector3(r, r, r), center + Vector3(r, r, r));
+    return true;
+}
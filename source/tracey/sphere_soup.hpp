@@ -0,0 +1,408 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu_features.hpp"
+#include "hittable.hpp"
+#include "render_stats.hpp"
+
+/// Structure-of-arrays view of spheres [0, count), as consumed by the
+/// intersection kernels. The kernels read whole registers of up to
+/// sphere_soup_kernels::max_lanes spheres, so the arrays must stay readable
+/// up to count rounded up to that; the spheres beyond count are ignored.
+struct SphereSoupView {
+    float const *center_x;
+    float const *center_y;
+    float const *center_z;
+    float const *radius;
+    std::size_t count;
+};
+
+/// Kernels returning the index of the nearest sphere hit by the ray within
+/// (t_min, t_max), or -1. On a hit t_hit holds the ray parameter. They compute
+/// exactly what hit_sphere() does for every sphere in turn, so that a set of
+/// spheres gives bit for bit the same hits whichever way it is intersected.
+namespace sphere_soup_kernels {
+
+/// Spheres of the widest kernel's registers.
+constexpr std::size_t const max_lanes = 16;
+
+using Kernel = long (*)(SphereSoupView const &, Vector3 const &,
+                        Vector3 const &, float, float, float &);
+
+inline long nearest_scalar(SphereSoupView const &s, Vector3 const &o,
+                           Vector3 const &d, float t_min, float t_max,
+                           float &t_hit) {
+    float const a = dot(d, d);
+    long best = -1;
+    float closest = t_max;
+    for (std::size_t i = 0; i != s.count; ++i) {
+        float const ocx = o.x() - s.center_x[i];
+        float const ocy = o.y() - s.center_y[i];
+        float const ocz = o.z() - s.center_z[i];
+        float const b = ocx * d.x() + ocy * d.y() + ocz * d.z();
+        float const c =
+            ocx * ocx + ocy * ocy + ocz * ocz - s.radius[i] * s.radius[i];
+        float const discriminant = b * b - a * c;
+        if (discriminant > 0.0f) {
+            float const root = std::sqrt(discriminant);
+            float t = (-b - root) / a;
+            if (!(t > t_min && t < closest)) {
+                t = (-b + root) / a;
+            }
+            if (t > t_min && t < closest) {
+                closest = t;
+                best = long(i);
+            }
+        }
+    }
+    t_hit = closest;
+    return best;
+}
+
+#if TRACEY_X86_KERNELS
+
+// Pick the lane with the smallest t, preferring lower indices on ties, which
+// matches the order in which the scalar kernel visits the spheres.
+template <int Lanes>
+inline long reduce_lanes(float const (&t)[Lanes], int const (&index)[Lanes],
+                         float &t_hit) {
+    long best = -1;
+    float closest = std::numeric_limits<float>::max();
+    for (int lane = 0; lane != Lanes; ++lane) {
+        if (index[lane] < 0) {
+            continue;
+        }
+        if (t[lane] < closest || (t[lane] == closest && index[lane] < best)) {
+            closest = t[lane];
+            best = index[lane];
+        }
+    }
+    if (best >= 0) {
+        t_hit = closest;
+    }
+    return best;
+}
+
+__attribute__((target("sse2"))) inline long
+nearest_sse2(SphereSoupView const &s, Vector3 const &o, Vector3 const &d,
+             float t_min, float t_max, float &t_hit) {
+    __m128 const a = _mm_set1_ps(dot(d, d));
+    __m128 const ox = _mm_set1_ps(o.x()), oy = _mm_set1_ps(o.y()),
+                 oz = _mm_set1_ps(o.z());
+    __m128 const dx = _mm_set1_ps(d.x()), dy = _mm_set1_ps(d.y()),
+                 dz = _mm_set1_ps(d.z());
+    __m128 const lower = _mm_set1_ps(t_min);
+    __m128 const zero = _mm_setzero_ps();
+    __m128 best_t = _mm_set1_ps(t_max);
+    __m128i best_index = _mm_set1_epi32(-1);
+    __m128 const sign = _mm_set1_ps(-0.0f);
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i const step = _mm_set1_epi32(4);
+    __m128i const count = _mm_set1_epi32(int(s.count));
+    for (std::size_t i = 0; i < s.count; i += 4) {
+        __m128 const ocx = _mm_sub_ps(ox, _mm_loadu_ps(s.center_x + i));
+        __m128 const ocy = _mm_sub_ps(oy, _mm_loadu_ps(s.center_y + i));
+        __m128 const ocz = _mm_sub_ps(oz, _mm_loadu_ps(s.center_z + i));
+        __m128 const r = _mm_loadu_ps(s.radius + i);
+        __m128 const b = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)),
+            _mm_mul_ps(ocz, dz));
+        __m128 const c = _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)),
+                       _mm_mul_ps(ocz, ocz)),
+            _mm_mul_ps(r, r));
+        __m128 const discriminant =
+            _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+        __m128 const has_roots =
+            _mm_and_ps(_mm_cmpgt_ps(discriminant, zero),
+                       _mm_castsi128_ps(_mm_cmplt_epi32(index, count)));
+        __m128 const root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+        __m128 const neg_b = _mm_xor_ps(b, sign);
+        __m128 const t0 = _mm_div_ps(_mm_sub_ps(neg_b, root), a);
+        __m128 const t1 = _mm_div_ps(_mm_add_ps(neg_b, root), a);
+        __m128 const valid0 =
+            _mm_and_ps(has_roots, _mm_and_ps(_mm_cmpgt_ps(t0, lower),
+                                             _mm_cmplt_ps(t0, best_t)));
+        __m128 const valid1 =
+            _mm_and_ps(has_roots, _mm_and_ps(_mm_cmpgt_ps(t1, lower),
+                                             _mm_cmplt_ps(t1, best_t)));
+        __m128 const t =
+            _mm_or_ps(_mm_and_ps(valid0, t0), _mm_andnot_ps(valid0, t1));
+        __m128 const valid = _mm_or_ps(valid0, valid1);
+        best_t = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, best_t));
+        __m128i const valid_i = _mm_castps_si128(valid);
+        best_index = _mm_or_si128(_mm_and_si128(valid_i, index),
+                                  _mm_andnot_si128(valid_i, best_index));
+        index = _mm_add_epi32(index, step);
+    }
+    float lane_t[4];
+    int lane_index[4];
+    _mm_storeu_ps(lane_t, best_t);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lane_index), best_index);
+    return reduce_lanes(lane_t, lane_index, t_hit);
+}
+
+__attribute__((target("avx2"))) inline long
+nearest_avx2(SphereSoupView const &s, Vector3 const &o, Vector3 const &d,
+             float t_min, float t_max, float &t_hit) {
+    __m256 const a = _mm256_set1_ps(dot(d, d));
+    __m256 const ox = _mm256_set1_ps(o.x()), oy = _mm256_set1_ps(o.y()),
+                 oz = _mm256_set1_ps(o.z());
+    __m256 const dx = _mm256_set1_ps(d.x()), dy = _mm256_set1_ps(d.y()),
+                 dz = _mm256_set1_ps(d.z());
+    __m256 const lower = _mm256_set1_ps(t_min);
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 best_t = _mm256_set1_ps(t_max);
+    __m256i best_index = _mm256_set1_epi32(-1);
+    __m256 const sign = _mm256_set1_ps(-0.0f);
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i const step = _mm256_set1_epi32(8);
+    __m256i const count = _mm256_set1_epi32(int(s.count));
+    for (std::size_t i = 0; i < s.count; i += 8) {
+        __m256 const ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(s.center_x + i));
+        __m256 const ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(s.center_y + i));
+        __m256 const ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(s.center_z + i));
+        __m256 const r = _mm256_loadu_ps(s.radius + i);
+        __m256 const b = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)),
+            _mm256_mul_ps(ocz, dz));
+        __m256 const c = _mm256_sub_ps(
+            _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                _mm256_mul_ps(ocz, ocz)),
+            _mm256_mul_ps(r, r));
+        __m256 const discriminant =
+            _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+        __m256 const has_roots = _mm256_and_ps(
+            _mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ),
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(count, index)));
+        __m256 const root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+        __m256 const neg_b = _mm256_xor_ps(b, sign);
+        __m256 const t0 = _mm256_div_ps(_mm256_sub_ps(neg_b, root), a);
+        __m256 const t1 = _mm256_div_ps(_mm256_add_ps(neg_b, root), a);
+        __m256 const valid0 = _mm256_and_ps(
+            has_roots, _mm256_and_ps(_mm256_cmp_ps(t0, lower, _CMP_GT_OQ),
+                                     _mm256_cmp_ps(t0, best_t, _CMP_LT_OQ)));
+        __m256 const valid1 = _mm256_and_ps(
+            has_roots, _mm256_and_ps(_mm256_cmp_ps(t1, lower, _CMP_GT_OQ),
+                                     _mm256_cmp_ps(t1, best_t, _CMP_LT_OQ)));
+        __m256 const t = _mm256_blendv_ps(t1, t0, valid0);
+        __m256 const valid = _mm256_or_ps(valid0, valid1);
+        best_t = _mm256_blendv_ps(best_t, t, valid);
+        best_index = _mm256_blendv_epi8(best_index, index,
+                                        _mm256_castps_si256(valid));
+        index = _mm256_add_epi32(index, step);
+    }
+    float lane_t[8];
+    int lane_index[8];
+    _mm256_storeu_ps(lane_t, best_t);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lane_index), best_index);
+    return reduce_lanes(lane_t, lane_index, t_hit);
+}
+
+// AVX-512 implies FMA, and GCC fuses multiplies and adds into it even across
+// intrinsics; keep them apart so that the kernel rounds like hit_sphere().
+#if defined(__clang__)
+#define TRACEY_SPHERE_SOUP_AVX512 __attribute__((target("avx512f")))
+#else
+#define TRACEY_SPHERE_SOUP_AVX512                                              \
+    __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+
+TRACEY_SPHERE_SOUP_AVX512 inline long
+nearest_avx512(SphereSoupView const &s, Vector3 const &o, Vector3 const &d,
+               float t_min, float t_max, float &t_hit) {
+    __m512 const a = _mm512_set1_ps(dot(d, d));
+    __m512 const ox = _mm512_set1_ps(o.x()), oy = _mm512_set1_ps(o.y()),
+                 oz = _mm512_set1_ps(o.z());
+    __m512 const dx = _mm512_set1_ps(d.x()), dy = _mm512_set1_ps(d.y()),
+                 dz = _mm512_set1_ps(d.z());
+    __m512 const lower = _mm512_set1_ps(t_min);
+    __m512 const zero = _mm512_setzero_ps();
+    __m512 best_t = _mm512_set1_ps(t_max);
+    __m512i best_index = _mm512_set1_epi32(-1);
+    __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+                                      12, 13, 14, 15);
+    __m512i const sign = _mm512_set1_epi32(std::int32_t(0x80000000u));
+    __m512i const step = _mm512_set1_epi32(16);
+    __m512i const count = _mm512_set1_epi32(int(s.count));
+    for (std::size_t i = 0; i < s.count; i += 16) {
+        __m512 const ocx = _mm512_sub_ps(ox, _mm512_loadu_ps(s.center_x + i));
+        __m512 const ocy = _mm512_sub_ps(oy, _mm512_loadu_ps(s.center_y + i));
+        __m512 const ocz = _mm512_sub_ps(oz, _mm512_loadu_ps(s.center_z + i));
+        __m512 const r = _mm512_loadu_ps(s.radius + i);
+        __m512 const b = _mm512_add_ps(
+            _mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)),
+            _mm512_mul_ps(ocz, dz));
+        __m512 const c = _mm512_sub_ps(
+            _mm512_add_ps(
+                _mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)),
+                _mm512_mul_ps(ocz, ocz)),
+            _mm512_mul_ps(r, r));
+        __m512 const discriminant =
+            _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_mul_ps(a, c));
+        __mmask16 const has_roots =
+            _mm512_mask_cmp_ps_mask(_mm512_cmplt_epi32_mask(index, count),
+                                    discriminant, zero, _CMP_GT_OQ);
+        // Zero-masked, which keeps lanes without roots away from negative
+        // square roots without reading an undefined source register.
+        __m512 const root = _mm512_maskz_sqrt_ps(has_roots, discriminant);
+        __m512 const neg_b = _mm512_castsi512_ps(
+            _mm512_xor_si512(_mm512_castps_si512(b), sign));
+        __m512 const t0 = _mm512_maskz_div_ps(
+            has_roots, _mm512_sub_ps(neg_b, root), a);
+        __m512 const t1 = _mm512_maskz_div_ps(
+            has_roots, _mm512_add_ps(neg_b, root), a);
+        __mmask16 const valid0 =
+            _mm512_mask_cmp_ps_mask(has_roots, t0, lower, _CMP_GT_OQ) &
+            _mm512_mask_cmp_ps_mask(has_roots, t0, best_t, _CMP_LT_OQ);
+        __mmask16 const valid1 =
+            _mm512_mask_cmp_ps_mask(has_roots, t1, lower, _CMP_GT_OQ) &
+            _mm512_mask_cmp_ps_mask(has_roots, t1, best_t, _CMP_LT_OQ);
+        __m512 const t = _mm512_mask_blend_ps(valid0, t1, t0);
+        __mmask16 const valid = valid0 | valid1;
+        best_t = _mm512_mask_blend_ps(valid, best_t, t);
+        best_index = _mm512_mask_blend_epi32(valid, best_index, index);
+        index = _mm512_add_epi32(index, step);
+    }
+    float lane_t[16];
+    int lane_index[16];
+    _mm512_storeu_ps(lane_t, best_t);
+    _mm512_storeu_si512(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, t_hit);
+}
+
+#endif // TRACEY_X86_KERNELS
+
+/// The kernel of a SIMD level.
+inline Kernel kernel(SimdLevel level) {
+    switch (level) {
+#if TRACEY_X86_KERNELS
+    case SimdLevel::sse2:
+        return nearest_sse2;
+    case SimdLevel::avx2:
+        return nearest_avx2;
+    case SimdLevel::avx512:
+        return nearest_avx512;
+#endif
+    default:
+        return nearest_scalar;
+    }
+}
+
+} // namespace sphere_soup_kernels
+
+/// Many spheres stored as a structure of arrays: centers, radii and material
+/// indices live in separate contiguous arrays. A ray is tested against 4, 8
+/// or 16 spheres per iteration with the widest kernel the CPU supports, which
+/// is much cheaper than a Composite of Sphere objects for dense sphere sets.
+/// It is a Hittable to compose scenes with; the renderer's own scenes do not
+/// use it, as their hierarchies leave only a few spheres per leaf.
+class SphereSoup : public Hittable {
+  public:
+    SphereSoup() { set_simd_level(best_simd_level()); }
+
+    /// Add a sphere and return its index.
+    std::size_t add_sphere(Vector3 const &center, float radius,
+                           Material const &material);
+
+    std::size_t size() const { return count; }
+
+    bool hit(Ray const &r, float t_min, float t_max,
+             HitRecord &rec) const override;
+    bool bounding_box(Aabb &box) const override;
+
+    /// Force a specific kernel, e.g. for benchmarking. Throws
+    /// std::invalid_argument if the CPU does not support it.
+    void set_simd_level(SimdLevel level);
+    SimdLevel simd_level() const { return level; }
+
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> radius;
+    std::vector<std::uint32_t> material_index;
+    /// Distinct materials referred to by material_index.
+    std::vector<Material const *> materials;
+
+  private:
+    /// The arrays are padded to a multiple of the widest kernel's registers.
+    static constexpr std::size_t padding = sphere_soup_kernels::max_lanes;
+
+    std::size_t count = 0;
+    SimdLevel level = SimdLevel::scalar;
+    sphere_soup_kernels::Kernel kernel = sphere_soup_kernels::nearest_scalar;
+    std::unordered_map<Material const *, std::uint32_t> material_lookup;
+};
+
+inline std::size_t SphereSoup::add_sphere(Vector3 const &center, float r,
+                                          Material const &material) {
+    if (count % padding == 0) {
+        float const nan = std::numeric_limits<float>::quiet_NaN();
+        std::size_t const padded = count + padding;
+        center_x.resize(padded, nan);
+        center_y.resize(padded, nan);
+        center_z.resize(padded, nan);
+        radius.resize(padded, 0.0f);
+        material_index.resize(padded, 0);
+    }
+    auto const found = material_lookup.find(&material);
+    std::uint32_t m;
+    if (found != material_lookup.end()) {
+        m = found->second;
+    } else {
+        m = std::uint32_t(materials.size());
+        materials.push_back(&material);
+        material_lookup.emplace(&material, m);
+    }
+    center_x[count] = center.x();
+    center_y[count] = center.y();
+    center_z[count] = center.z();
+    radius[count] = r;
+    material_index[count] = m;
+    return count++;
+}
+
+inline bool SphereSoup::hit(Ray const &r, float t_min, float t_max,
+                            HitRecord &rec) const {
+    TRACEY_STAT(thread_stats().intersection_tests.add(count);)
+    SphereSoupView const view{center_x.data(), center_y.data(),
+                              center_z.data(), radius.data(), count};
+    float t;
+    long const i = kernel(view, r.origin(), r.direction(), t_min, t_max, t);
+    if (i < 0) {
+        return false;
+    }
+    Vector3 const center(center_x[std::size_t(i)], center_y[std::size_t(i)],
+                         center_z[std::size_t(i)]);
+    rec.t = t;
+    rec.p = r.point_at_parameter(t);
+    rec.normal = (rec.p - center) / radius[std::size_t(i)];
+    rec.material = materials[material_index[std::size_t(i)]];
+    return true;
+}
+
+inline bool SphereSoup::bounding_box(Aabb &box) const {
+    box = Aabb();
+    for (std::size_t i = 0; i != count; ++i) {
+        float const r = std::abs(radius[i]);
+        Vector3 const center(center_x[i], center_y[i], center_z[i]);
+        box.expand(center - Vector3(r, r, r));
+        box.expand(center + Vector3(r, r, r));
+    }
+    return count != 0;
+}
+
+inline void SphereSoup::set_simd_level(SimdLevel new_level) {
+    if (!simd_level_supported(new_level)) {
+        throw std::invalid_argument("SIMD level not supported by this CPU");
+    }
+    level = new_level;
+    kernel = sphere_soup_kernels::kernel(level);
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "bvh.hpp"
+#include "hittable.hpp"
+#include "lambertian.hpp"
+#include "material.hpp"
+#include "metal.hpp"
+#include "sphere.hpp"
+#include "sphere_soup.hpp"
+#include "triangle_mesh.hpp"
+
+/// The closed set of materials known to StaticScene.
+using StaticMaterial = std::variant<Lambertian, Metal>;
+
+/// Sphere referring to its material by index into StaticScene::materials.
+struct StaticSphere {
+    Vector3 center;
+    float radius;
+    std::uint32_t material;
+};
+
+/// Scene over a closed set of primitive and material types, stored by value:
+/// spheres and triangle meshes. build() packs what intersection reads, the
+/// sphere centers and radii, into cache line aligned arrays of each
+/// coordinate in the leaf order of the hierarchy, away from the material
+/// indices which are only looked up for the nearest hit. The spheres of a
+/// leaf are tested together with the SphereSoup kernels (see
+/// sphere_soup.hpp), which hit exactly what hit_sphere() does. Meshes have
+/// hierarchies of their own and are tested after the spheres, which suits
+/// scenes with a few large meshes. Its hit() is final and the scatter() and
+/// material_type() overloads below dispatch on the material variant, so
+/// integrators instantiated for a StaticScene intersect and shade without any
+/// virtual calls. Scenes using types outside the closed set go through the
+/// virtual Hittable and Material interfaces instead.
+class StaticScene final : public Hittable {
+  public:
+    /// Add a material, returning its index.
+    std::uint32_t add_material(StaticMaterial const &material);
+    void add_sphere(Vector3 const &center, float radius,
+                    std::uint32_t material);
+    /// Copy a sphere of the virtual interface into the scene. Returns false,
+    /// adding nothing, if its material is not part of the closed set.
+    bool add_sphere(Sphere const &sphere);
+    /// Add a mesh whose triangles all have the given material.
+    void add_mesh(TriangleMesh mesh, std::uint32_t material);
+
+    /// Build the acceleration structure. Must be called after adding spheres
+    /// or materials and before hit().
+    void build();
+
+    /// The sphere added index-th, wherever build() moved it.
+    StaticSphere &sphere(std::uint32_t index) { return spheres[slots[index]]; }
+
+    /// Update the acceleration structure to spheres moved or resized since
+    /// build(), keeping its structure; see BvhTree::refit().
+    void refit();
+
+    bool hit(Ray const &r, float t_min, float t_max,
+             HitRecord &rec) const override;
+    bool bounding_box(Aabb &box) const override;
+
+    /// Force a specific sphere kernel, e.g. for benchmarking. Throws
+    /// std::invalid_argument if the CPU does not support it.
+    void set_simd_level(SimdLevel level);
+    SimdLevel simd_level() const { return level; }
+
+    /// Spheres, reordered by build(); see sphere().
+    std::vector<StaticSphere> spheres;
+    std::vector<TriangleMesh> meshes;
+    /// Material index of every mesh.
+    std::vector<std::uint32_t> mesh_materials;
+    std::vector<StaticMaterial> materials;
+
+  private:
+    using PackedArray =
+        std::vector<float, AlignedAllocator<float, cache_line_size>>;
+
+    /// Sphere bounds, in leaf order after build().
+    std::vector<Aabb> sphere_bounds() const;
+    /// Copy the hot sphere data into the packed arrays.
+    void pack();
+
+    BvhTree tree;
+    /// Position in spheres of every sphere index.
+    std::vector<std::uint32_t> slots;
+    /// Sphere centers and radii in leaf order, padded for the kernels.
+    PackedArray center_x;
+    PackedArray center_y;
+    PackedArray center_z;
+    PackedArray radii;
+    std::vector<std::uint32_t> packed_materials;
+    /// Leaves hold at most 8 spheres, too few to fill AVX-512 registers.
+    SimdLevel level = std::min(best_simd_level(), SimdLevel::avx2);
+    sphere_soup_kernels::Kernel kernel = sphere_soup_kernels::kernel(level);
+    /// Base class pointers into materials, for HitRecord::material.
+    std::vector<Material const *> material_pointers;
+    /// Materials copied by add_sphere(Sphere const &), by their source.
+    std::unordered_map<Material const *, std::uint32_t> copied_materials;
+};
+
+inline std::uint32_t StaticScene::add_material(StaticMaterial const &material) {
+    materials.push_back(material);
+    return std::uint32_t(materials.size() - 1);
+}
+
+inline void StaticScene::add_sphere(Vector3 const &center, float radius,
+                                    std::uint32_t material) {
+    spheres.push_back(StaticSphere{center, radius, material});
+    slots.push_back(std::uint32_t(spheres.size() - 1));
+}
+
+inline void StaticScene::add_mesh(TriangleMesh mesh, std::uint32_t material) {
+    meshes.push_back(std::move(mesh));
+    mesh_materials.push_back(material);
+}
+
+inline bool StaticScene::add_sphere(Sphere const &sphere) {
+    auto found = copied_materials.find(sphere.material);
+    if (found == copied_materials.end()) {
+        std::uint32_t index;
+        if (auto const *lambertian =
+                dynamic_cast<Lambertian const *>(sphere.material)) {
+            index = add_material(*lambertian);
+        } else if (auto const *metal =
+                       dynamic_cast<Metal const *>(sphere.material)) {
+            index = add_material(*metal);
+        } else {
+            return false;
+        }
+        found = copied_materials.emplace(sphere.material, index).first;
+    }
+    add_sphere(sphere.center, sphere.radius, found->second);
+    return true;
+}
+
+inline void StaticScene::build() {
+    material_pointers.clear();
+    for (auto const &material : materials) {
+        material_pointers.push_back(std::visit(
+            [](auto const &m) -> Material const * { return &m; }, material));
+    }
+    // Spheres appended to spheres directly count as added in that order.
+    for (std::size_t i = slots.size(); i < spheres.size(); ++i) {
+        slots.push_back(std::uint32_t(i));
+    }
+    tree.build(sphere_bounds());
+    std::vector<StaticSphere> ordered;
+    std::vector<std::uint32_t> position(spheres.size());
+    ordered.reserve(spheres.size());
+    for (std::uint32_t index : tree.order()) {
+        position[index] = std::uint32_t(ordered.size());
+        ordered.push_back(spheres[index]);
+    }
+    for (auto &slot : slots) {
+        slot = position[slot];
+    }
+    spheres = std::move(ordered);
+    pack();
+    for (std::size_t m = 0; m != meshes.size(); ++m) {
+        meshes[m].material = material_pointers[mesh_materials[m]];
+        meshes[m].build();
+    }
+}
+
+inline void StaticScene::refit() {
+    tree.refit(sphere_bounds());
+    pack();
+}
+
+inline std::vector<Aabb> StaticScene::sphere_bounds() const {
+    std::vector<Aabb> bounds;
+    bounds.reserve(spheres.size());
+    for (auto const &sphere : spheres) {
+        float const r = std::abs(sphere.radius);
+        bounds.emplace_back(sphere.center - Vector3(r, r, r),
+                            sphere.center + Vector3(r, r, r));
+    }
+    return bounds;
+}
+
+inline void StaticScene::pack() {
+    std::size_t const padded = spheres.size() + sphere_soup_kernels::max_lanes;
+    float const nan = std::numeric_limits<float>::quiet_NaN();
+    for (PackedArray *array : {&center_x, &center_y, &center_z, &radii}) {
+        array->assign(padded, nan);
+    }
+    packed_materials.clear();
+    packed_materials.reserve(spheres.size());
+    for (std::size_t i = 0; i != spheres.size(); ++i) {
+        center_x[i] = spheres[i].center.x();
+        center_y[i] = spheres[i].center.y();
+        center_z[i] = spheres[i].center.z();
+        radii[i] = spheres[i].radius;
+        packed_materials.push_back(spheres[i].material);
+    }
+}
+
+inline bool StaticScene::hit(Ray const &r, float t_min, float t_max,
+                             HitRecord &rec) const {
+    float closest_so_far = t_max;
+    std::size_t nearest = 0;
+    bool hit_anything = tree.traverse(
+        r, t_min, closest_so_far,
+        [&](std::uint32_t first, std::uint32_t count, float &closest) {
+            TRACEY_STAT(thread_stats().intersection_tests.add(count);)
+            SphereSoupView const leaf{center_x.data() + first,
+                                      center_y.data() + first,
+                                      center_z.data() + first,
+                                      radii.data() + first, count};
+            long const i = kernel(leaf, r.origin(), r.direction(), t_min,
+                                  closest, closest);
+            if (i < 0) {
+                return false;
+            }
+            nearest = first + std::size_t(i);
+            return true;
+        });
+    if (hit_anything) {
+        Vector3 const center(center_x[nearest], center_y[nearest],
+                             center_z[nearest]);
+        rec.t = closest_so_far;
+        rec.p = r.point_at_parameter(rec.t);
+        rec.normal = (rec.p - center) / radii[nearest];
+        rec.material_index = packed_materials[nearest];
+        rec.material = material_pointers[rec.material_index];
+    }
+    for (std::size_t m = 0; m != meshes.size(); ++m) {
+        if (meshes[m].hit(r, t_min, closest_so_far, rec)) {
+            hit_anything = true;
+            closest_so_far = rec.t;
+            rec.material_index = mesh_materials[m];
+        }
+    }
+    return hit_anything;
+}
+
+inline void StaticScene::set_simd_level(SimdLevel new_level) {
+    if (!simd_level_supported(new_level)) {
+        throw std::invalid_argument("SIMD level not supported by this CPU");
+    }
+    level = new_level;
+    kernel = sphere_soup_kernels::kernel(level);
+}
+
+inline bool StaticScene::bounding_box(Aabb &box) const {
+    box = Aabb();
+    if (!tree.empty()) {
+        box = tree.bounds();
+    }
+    for (auto const &mesh : meshes) {
+        Aabb mesh_box;
+        if (mesh.bounding_box(mesh_box)) {
+            box.expand(mesh_box);
+        }
+    }
+    return !box.empty();
+}
+
+/// Scatter through the material variant, calling the concrete scatter()
+/// directly instead of through the vtable.
+inline bool scatter(StaticScene const &scene, Ray const &ray,
+                    HitRecord const &record, Vector3 &attenuation,
+                    Ray &scattered, Sampler &sampler) {
+    return std::visit(
+        [&](auto const &material) {
+            using Type = std::decay_t<decltype(material)>;
+            return material.Type::scatter(ray, record, attenuation, scattered,
+                                          sampler);
+        },
+        scene.materials[record.material_index]);
+}
+
+inline MaterialType material_type(StaticScene const &scene,
+                                  HitRecord const &record) {
+    return std::visit(
+        [](auto const &material) {
+            using Type = std::decay_t<decltype(material)>;
+            return material.Type::type();
+        },
+        scene.materials[record.material_index]);
+}
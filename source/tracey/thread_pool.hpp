@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed-size pool of worker threads executing index ranges with work
+/// stealing. Every worker owns a queue of item indices; once its own queue is
+/// exhausted it steals from the back of the other queues. The thread calling
+/// parallel_for() acts as worker 0, so a pool with a single worker runs
+/// everything serially on the calling thread.
+class ThreadPool {
+  public:
+    explicit ThreadPool(unsigned worker_count = default_worker_count());
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+    ~ThreadPool();
+
+    /// Number of workers, including the calling thread.
+    unsigned worker_count() const { return unsigned(queues.size()); }
+
+    /// Invoke task(i) for every i in [0, count) and block until all of them
+    /// have completed. The first exception thrown by a task is rethrown here.
+    template <typename Task> void parallel_for(std::size_t count, Task &&task) {
+        std::function<void(std::size_t)> const job = std::ref(task);
+        run(count, job);
+    }
+
+    static unsigned default_worker_count() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+  private:
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<std::size_t> items;
+    };
+
+    void run(std::size_t count, std::function<void(std::size_t)> const &job);
+    void worker_loop(unsigned index);
+    void drain(unsigned index);
+    bool pop(unsigned index, std::size_t &item);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(std::size_t)> const *current_job = nullptr;
+    std::uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+};
+
+inline ThreadPool::ThreadPool(unsigned worker_count) {
+    worker_count = std::max(1u, worker_count);
+    for (unsigned i = 0; i != worker_count; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned i = 1; i != worker_count; ++i) {
+        threads.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+inline void ThreadPool::run(std::size_t count,
+                            std::function<void(std::size_t)> const &job) {
+    if (count == 0) {
+        return;
+    }
+    // Hand out contiguous chunks, so that without stealing each worker walks
+    // neighbouring items.
+    std::size_t const n = queues.size();
+    for (std::size_t w = 0; w != n; ++w) {
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        queues[w]->items.clear();
+        for (std::size_t i = count * w / n; i != count * (w + 1) / n; ++i) {
+            queues[w]->items.push_back(i);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_job = &job;
+        error = nullptr;
+        busy = unsigned(threads.size());
+        ++generation;
+    }
+    wake.notify_all();
+    drain(0);
+    std::exception_ptr failure;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        current_job = nullptr;
+        failure = error;
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+inline void ThreadPool::worker_loop(unsigned index) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock,
+                      [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        drain(index);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) {
+                done.notify_all();
+            }
+        }
+    }
+}
+
+inline void ThreadPool::drain(unsigned index) {
+    std::size_t item;
+    while (pop(index, item)) {
+        try {
+            (*current_job)(item);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
+
+inline bool ThreadPool::pop(unsigned index, std::size_t &item) {
+    // Own queue first, from the front...
+    {
+        WorkQueue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            item = own.items.front();
+            own.items.pop_front();
+            return true;
+        }
+    }
+    // ... then steal from the back of everyone else's.
+    std::size_t const n = queues.size();
+    for (std::size_t k = 1; k != n; ++k) {
+        WorkQueue &victim = *queues[(index + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            item = victim.items.back();
+            victim.items.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "render_stats.hpp"
+#include "thread_pool.hpp"
+
+/// A rectangular block of pixels [x_begin, x_end) x [y_begin, y_end).
+struct Tile {
+    int x_begin;
+    int y_begin;
+    int x_end;
+    int y_end;
+};
+
+/// Split a region of an image into tiles of at most tile_size pixels along
+/// each side, ordered row by row.
+inline std::vector<Tile> split_into_tiles(Tile const &region, int tile_size) {
+    std::vector<Tile> tiles;
+    tile_size = std::max(1, tile_size);
+    for (int y = region.y_begin; y < region.y_end; y += tile_size) {
+        for (int x = region.x_begin; x < region.x_end; x += tile_size) {
+            tiles.push_back(Tile{x, y, std::min(x + tile_size, region.x_end),
+                                 std::min(y + tile_size, region.y_end)});
+        }
+    }
+    return tiles;
+}
+
+/// Split a width times height image into tiles of at most tile_size pixels
+/// along each side, ordered row by row.
+inline std::vector<Tile> split_into_tiles(int width, int height,
+                                          int tile_size) {
+    return split_into_tiles(Tile{0, 0, width, height}, tile_size);
+}
+
+/// Split a width times height image into bands of at most band_rows full
+/// rows. Bands are ordered from the top of the image down, the order in which
+/// image files store rows; row 0 is the bottom row.
+inline std::vector<Tile> split_into_bands(int width, int height,
+                                          int band_rows) {
+    std::vector<Tile> bands;
+    band_rows = std::max(1, band_rows);
+    for (int y = height; y > 0; y -= band_rows) {
+        bands.push_back(Tile{0, std::max(0, y - band_rows), width, y});
+    }
+    return bands;
+}
+
+/// Renders an image tile by tile on a thread pool. What happens inside a tile
+/// is up to the caller; tiles never overlap, so the tile function may write to
+/// its own pixels without synchronisation.
+class TileRenderer {
+  public:
+    explicit TileRenderer(ThreadPool &pool, int tile_size = 32)
+        : pool(pool), tile_size(tile_size) {}
+
+    /// Call render_tile(tile, tile_index) for every tile of the image and
+    /// progress(tiles_done, tiles_total) after each one finishes. Progress
+    /// calls are serialised but may come from any worker.
+    template <typename TileFunction, typename ProgressFunction>
+    void render(int width, int height, TileFunction &&render_tile,
+                ProgressFunction &&progress) const {
+        render_region(Tile{0, 0, width, height},
+                      std::forward<TileFunction>(render_tile),
+                      std::forward<ProgressFunction>(progress));
+    }
+
+    template <typename TileFunction>
+    void render(int width, int height, TileFunction &&render_tile) const {
+        render(width, height, std::forward<TileFunction>(render_tile),
+               [](std::size_t, std::size_t) {});
+    }
+
+    /// Like render(), restricted to the tiles of a region of the image, e.g.
+    /// one band of rows when streaming.
+    template <typename TileFunction, typename ProgressFunction>
+    void render_region(Tile const &region, TileFunction &&render_tile,
+                       ProgressFunction &&progress) const {
+        std::vector<Tile> const tiles = split_into_tiles(region, tile_size);
+        std::mutex progress_mutex;
+        std::size_t tiles_done = 0;
+        pool.parallel_for(tiles.size(), [&](std::size_t index) {
+            TRACEY_STAT(auto const start = std::chrono::steady_clock::now();)
+            render_tile(tiles[index], index);
+            TRACEY_STAT(thread_stats().add_tile(std::uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count()));)
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            progress(++tiles_done, tiles.size());
+        });
+    }
+
+  private:
+    ThreadPool &pool;
+    int tile_size;
+};
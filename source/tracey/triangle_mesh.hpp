@@ -0,0 +1,349 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bvh.hpp"
+#include "cpu_features.hpp"
+#include "hittable.hpp"
+#include "render_stats.hpp"
+
+/// The triangles of one hierarchy leaf as a structure of arrays, in the form
+/// the Moller-Trumbore test consumes: a vertex and the two edges leaving it.
+/// Lanes past the leaf's triangles have NaN vertices and are never hit.
+struct alignas(32) TriangleBatch {
+    static constexpr int size = 8;
+
+    float v0x[size], v0y[size], v0z[size];
+    float e1x[size], e1y[size], e1z[size];
+    float e2x[size], e2y[size], e2z[size];
+};
+
+/// Kernels computing for every lane of a batch the distance along the ray to
+/// its triangle, or infinity where the ray misses it within (t_min, t_max).
+/// All of them evaluate the same expressions in the same order, so they agree
+/// to the bit.
+namespace triangle_kernels {
+
+inline void distances_scalar(TriangleBatch const &b, Vector3 const &o,
+                             Vector3 const &d, float t_min, float t_max,
+                             float (&t)[TriangleBatch::size]) {
+    for (int i = 0; i != TriangleBatch::size; ++i) {
+        float const px = d.y() * b.e2z[i] - d.z() * b.e2y[i];
+        float const py = d.z() * b.e2x[i] - d.x() * b.e2z[i];
+        float const pz = d.x() * b.e2y[i] - d.y() * b.e2x[i];
+        float const det = b.e1x[i] * px + b.e1y[i] * py + b.e1z[i] * pz;
+        float const inv_det = 1.0f / det;
+        float const sx = o.x() - b.v0x[i];
+        float const sy = o.y() - b.v0y[i];
+        float const sz = o.z() - b.v0z[i];
+        float const u = (sx * px + sy * py + sz * pz) * inv_det;
+        float const qx = sy * b.e1z[i] - sz * b.e1y[i];
+        float const qy = sz * b.e1x[i] - sx * b.e1z[i];
+        float const qz = sx * b.e1y[i] - sy * b.e1x[i];
+        float const v = (d.x() * qx + d.y() * qy + d.z() * qz) * inv_det;
+        float const distance =
+            (b.e2x[i] * qx + b.e2y[i] * qy + b.e2z[i] * qz) * inv_det;
+        // A zero determinant, a ray parallel to the triangle, makes u or v
+        // infinite or NaN, which fails these comparisons.
+        bool const hit = u >= 0.0f && v >= 0.0f && u + v <= 1.0f &&
+                         distance > t_min && distance < t_max;
+        t[i] = hit ? distance : std::numeric_limits<float>::infinity();
+    }
+}
+
+#if TRACEY_X86_KERNELS
+
+__attribute__((target("sse2"))) inline void
+distances_sse2(TriangleBatch const &b, Vector3 const &o, Vector3 const &d,
+               float t_min, float t_max, float (&t)[TriangleBatch::size]) {
+    __m128 const ox = _mm_set1_ps(o.x()), oy = _mm_set1_ps(o.y()),
+                 oz = _mm_set1_ps(o.z());
+    __m128 const dx = _mm_set1_ps(d.x()), dy = _mm_set1_ps(d.y()),
+                 dz = _mm_set1_ps(d.z());
+    __m128 const lower = _mm_set1_ps(t_min);
+    __m128 const upper = _mm_set1_ps(t_max);
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const one = _mm_set1_ps(1.0f);
+    __m128 const miss = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    for (int i = 0; i != TriangleBatch::size; i += 4) {
+        __m128 const e1x = _mm_load_ps(b.e1x + i), e1y = _mm_load_ps(b.e1y + i),
+                     e1z = _mm_load_ps(b.e1z + i);
+        __m128 const e2x = _mm_load_ps(b.e2x + i), e2y = _mm_load_ps(b.e2y + i),
+                     e2z = _mm_load_ps(b.e2z + i);
+        __m128 const px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 const py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 const pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 const det = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+            _mm_mul_ps(e1z, pz));
+        __m128 const inv_det = _mm_div_ps(one, det);
+        __m128 const sx = _mm_sub_ps(ox, _mm_load_ps(b.v0x + i));
+        __m128 const sy = _mm_sub_ps(oy, _mm_load_ps(b.v0y + i));
+        __m128 const sz = _mm_sub_ps(oz, _mm_load_ps(b.v0z + i));
+        __m128 const u = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                       _mm_mul_ps(sz, pz)),
+            inv_det);
+        __m128 const qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 const qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 const qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 const v = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                       _mm_mul_ps(dz, qz)),
+            inv_det);
+        __m128 const distance = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                       _mm_mul_ps(e2z, qz)),
+            inv_det);
+        __m128 const hit = _mm_and_ps(
+            _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+                       _mm_cmple_ps(_mm_add_ps(u, v), one)),
+            _mm_and_ps(_mm_cmpgt_ps(distance, lower),
+                       _mm_cmplt_ps(distance, upper)));
+        _mm_store_ps(t + i, _mm_or_ps(_mm_and_ps(hit, distance),
+                                      _mm_andnot_ps(hit, miss)));
+    }
+}
+
+__attribute__((target("avx2"))) inline void
+distances_avx2(TriangleBatch const &b, Vector3 const &o, Vector3 const &d,
+               float t_min, float t_max, float (&t)[TriangleBatch::size]) {
+    static_assert(TriangleBatch::size == 8, "One AVX register per batch");
+    __m256 const dx = _mm256_set1_ps(d.x()), dy = _mm256_set1_ps(d.y()),
+                 dz = _mm256_set1_ps(d.z());
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const one = _mm256_set1_ps(1.0f);
+    __m256 const e1x = _mm256_load_ps(b.e1x), e1y = _mm256_load_ps(b.e1y),
+                 e1z = _mm256_load_ps(b.e1z);
+    __m256 const e2x = _mm256_load_ps(b.e2x), e2y = _mm256_load_ps(b.e2y),
+                 e2z = _mm256_load_ps(b.e2z);
+    __m256 const px =
+        _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 const py =
+        _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 const pz =
+        _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    __m256 const det = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+        _mm256_mul_ps(e1z, pz));
+    __m256 const inv_det = _mm256_div_ps(one, det);
+    __m256 const sx =
+        _mm256_sub_ps(_mm256_set1_ps(o.x()), _mm256_load_ps(b.v0x));
+    __m256 const sy =
+        _mm256_sub_ps(_mm256_set1_ps(o.y()), _mm256_load_ps(b.v0y));
+    __m256 const sz =
+        _mm256_sub_ps(_mm256_set1_ps(o.z()), _mm256_load_ps(b.v0z));
+    __m256 const u = _mm256_mul_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)),
+            _mm256_mul_ps(sz, pz)),
+        inv_det);
+    __m256 const qx =
+        _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    __m256 const qy =
+        _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    __m256 const qz =
+        _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    __m256 const v = _mm256_mul_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+            _mm256_mul_ps(dz, qz)),
+        inv_det);
+    __m256 const distance = _mm256_mul_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+            _mm256_mul_ps(e2z, qz)),
+        inv_det);
+    __m256 const inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ),
+                      _mm256_cmp_ps(v, zero, _CMP_GE_OQ)),
+        _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    __m256 const in_range = _mm256_and_ps(
+        _mm256_cmp_ps(distance, _mm256_set1_ps(t_min), _CMP_GT_OQ),
+        _mm256_cmp_ps(distance, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+    _mm256_store_ps(
+        t, _mm256_blendv_ps(
+               _mm256_set1_ps(std::numeric_limits<float>::infinity()),
+               distance, _mm256_and_ps(inside, in_range)));
+}
+
+#endif // TRACEY_X86_KERNELS
+
+} // namespace triangle_kernels
+
+/// Triangle mesh with shared vertices: every triangle is three indices into
+/// one vertex array, which costs 12 bytes per vertex and 12 per triangle plus
+/// the hierarchy, instead of 36 bytes per triangle for separate triangles.
+/// With MATHY_SIMD a Vector3 takes 16 bytes, so a vertex does too and a
+/// separate triangle 48. build() creates a hierarchy over the triangles of this mesh alone and
+/// reorders the triangles so that every leaf covers a contiguous range. On
+/// a hit the leaf's triangles, at most TriangleBatch::size, are gathered into
+/// a batch and tested together with the widest kernel the CPU supports (AVX2,
+/// as leaves are too small to fill AVX-512 registers).
+///
+/// Triangles are two-sided: the normal of a hit faces the incoming ray. All
+/// triangles share one material.
+class TriangleMesh : public Hittable {
+  public:
+    TriangleMesh() { set_simd_level(best_simd_level()); }
+
+    std::size_t triangle_count() const { return indices.size() / 3; }
+
+    /// Build the hierarchy. Must be called after changing positions or indices
+    /// and before hit(). Throws std::invalid_argument if the indices do not
+    /// form triangles of existing vertices.
+    void build();
+
+    bool hit(Ray const &r, float t_min, float t_max,
+             HitRecord &rec) const override;
+    bool bounding_box(Aabb &box) const override;
+
+    /// Force a specific kernel, e.g. for benchmarking. Throws
+    /// std::invalid_argument if the CPU does not support it.
+    void set_simd_level(SimdLevel level);
+    SimdLevel simd_level() const { return level; }
+
+    std::vector<Vector3> positions;
+    /// Three vertex indices per triangle, reordered by build().
+    std::vector<std::uint32_t> indices;
+    Material const *material = nullptr;
+
+  private:
+    static_assert(BvhTree::max_leaf_size <= TriangleBatch::size,
+                  "A leaf has to fit into one batch");
+
+    using Kernel = void (*)(TriangleBatch const &, Vector3 const &,
+                            Vector3 const &, float, float,
+                            float (&)[TriangleBatch::size]);
+
+    /// Load triangles [first, first + count) into a batch.
+    void gather(std::uint32_t first, std::uint32_t count,
+                TriangleBatch &batch) const;
+
+    BvhTree tree;
+    SimdLevel level = SimdLevel::scalar;
+    Kernel kernel = triangle_kernels::distances_scalar;
+};
+
+inline void TriangleMesh::build() {
+    if (indices.size() % 3 != 0) {
+        throw std::invalid_argument("TriangleMesh needs three indices per "
+                                    "triangle");
+    }
+    std::vector<Aabb> bounds(triangle_count());
+    for (std::size_t i = 0; i != indices.size(); ++i) {
+        if (indices[i] >= positions.size()) {
+            throw std::invalid_argument("TriangleMesh vertex index out of "
+                                        "range");
+        }
+        bounds[i / 3].expand(positions[indices[i]]);
+    }
+    tree.build(bounds);
+    std::vector<std::uint32_t> ordered;
+    ordered.reserve(indices.size());
+    for (std::uint32_t triangle : tree.order()) {
+        for (std::size_t corner = 0; corner != 3; ++corner) {
+            ordered.push_back(indices[3 * std::size_t(triangle) + corner]);
+        }
+    }
+    indices = std::move(ordered);
+}
+
+inline void TriangleMesh::gather(std::uint32_t first, std::uint32_t count,
+                                 TriangleBatch &batch) const {
+    std::uint32_t const *corners = indices.data() + 3 * std::size_t(first);
+    int lane = 0;
+    for (; lane != int(count); ++lane, corners += 3) {
+        Vector3 const &v0 = positions[corners[0]];
+        Vector3 const e1 = positions[corners[1]] - v0;
+        Vector3 const e2 = positions[corners[2]] - v0;
+        batch.v0x[lane] = v0.x();
+        batch.v0y[lane] = v0.y();
+        batch.v0z[lane] = v0.z();
+        batch.e1x[lane] = e1.x();
+        batch.e1y[lane] = e1.y();
+        batch.e1z[lane] = e1.z();
+        batch.e2x[lane] = e2.x();
+        batch.e2y[lane] = e2.y();
+        batch.e2z[lane] = e2.z();
+    }
+    float const nan = std::numeric_limits<float>::quiet_NaN();
+    for (; lane != TriangleBatch::size; ++lane) {
+        batch.v0x[lane] = batch.v0y[lane] = batch.v0z[lane] = nan;
+        batch.e1x[lane] = batch.e1y[lane] = batch.e1z[lane] = 0.0f;
+        batch.e2x[lane] = batch.e2y[lane] = batch.e2z[lane] = 0.0f;
+    }
+}
+
+inline bool TriangleMesh::hit(Ray const &r, float t_min, float t_max,
+                              HitRecord &rec) const {
+    float closest_so_far = t_max;
+    std::uint32_t nearest = 0;
+    bool const hit_anything = tree.traverse(
+        r, t_min, closest_so_far,
+        [&](std::uint32_t first, std::uint32_t count, float &closest) {
+            TRACEY_STAT(thread_stats().intersection_tests.add(count);)
+            TriangleBatch batch;
+            gather(first, count, batch);
+            alignas(32) float t[TriangleBatch::size];
+            kernel(batch, r.origin(), r.direction(), t_min, closest, t);
+            bool hit_leaf = false;
+            for (std::uint32_t lane = 0; lane != count; ++lane) {
+                if (t[lane] < closest) {
+                    closest = t[lane];
+                    nearest = first + lane;
+                    hit_leaf = true;
+                }
+            }
+            return hit_leaf;
+        });
+    if (!hit_anything) {
+        return false;
+    }
+    std::uint32_t const *corners = indices.data() + 3 * std::size_t(nearest);
+    Vector3 const &v0 = positions[corners[0]];
+    Vector3 normal = unit_vector(
+        cross(positions[corners[1]] - v0, positions[corners[2]] - v0));
+    if (dot(normal, r.direction()) > 0.0f) {
+        normal = -normal;
+    }
+    rec.t = closest_so_far;
+    rec.p = r.point_at_parameter(rec.t);
+    rec.normal = normal;
+    rec.material = material;
+    return true;
+}
+
+inline bool TriangleMesh::bounding_box(Aabb &box) const {
+    if (tree.empty()) {
+        return false;
+    }
+    box = tree.bounds();
+    return true;
+}
+
+inline void TriangleMesh::set_simd_level(SimdLevel new_level) {
+    if (!simd_level_supported(new_level)) {
+        throw std::invalid_argument("SIMD level not supported by this CPU");
+    }
+    level = new_level;
+    switch (level) {
+#if TRACEY_X86_KERNELS
+    case SimdLevel::sse2:
+        kernel = triangle_kernels::distances_sse2;
+        break;
+    case SimdLevel::avx2:
+    case SimdLevel::avx512:
+        kernel = triangle_kernels::distances_avx2;
+        break;
+#endif
+    default:
+        kernel = triangle_kernels::distances_scalar;
+        break;
+    }
+}
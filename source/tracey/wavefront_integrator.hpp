@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "integrator.hpp"
+#include "lambertian.hpp"
+#include "material.hpp"
+#include "metal.hpp"
+#include "render_stats.hpp"
+#include "sampling.hpp"
+#include "tile_renderer.hpp"
+
+/// Traces all paths of a tile breadth first. The live paths sit in a
+/// structure-of-arrays queue which is processed in batched passes per bounce:
+///   1. extend: intersect every queued ray with the world,
+///   2. shade: scatter the hits, grouped by material type so that the built-in
+///      materials are shaded without virtual calls,
+///   3. the paths surviving scattering and Russian roulette are compacted into
+///      the queue for the next bounce.
+/// Finished paths leave their color in a slot per path of the wave, which are
+/// added up in sample order once the wave is done.
+/// Paths are sampled and their samples summed exactly like in PathIntegrator,
+/// so both produce the same image, however the samples are grouped into waves
+/// or passes.
+class WavefrontIntegrator {
+  public:
+    /// wave_size bounds the number of paths in flight per tile; larger tiles
+    /// or sample counts are processed in several waves.
+    explicit WavefrontIntegrator(std::size_t wave_size = std::size_t(1) << 16)
+        : wave_size(std::max<std::size_t>(1, wave_size)) {}
+
+    /// Trace the requested samples of the pixels in tile and add them to
+    /// accumulator, which must already be sized for the tile.
+    template <typename World>
+    void render_tile(Tile const &tile, Camera const &cam, World const &world,
+                     RenderSettings const &settings,
+                     SampleRequest const &request,
+                     TileAccumulator &accumulator) const;
+
+  private:
+    /// Live paths in structure-of-arrays layout.
+    struct PathQueue {
+        std::vector<float> origin_x, origin_y, origin_z;
+        std::vector<float> direction_x, direction_y, direction_z;
+        std::vector<float> throughput_r, throughput_g, throughput_b;
+        /// Index of the path in its wave.
+        std::vector<std::uint32_t> path;
+        std::vector<Sampler> sampler;
+        std::size_t size = 0;
+
+        void reserve(std::size_t capacity) {
+            for (auto *v : {&origin_x, &origin_y, &origin_z, &direction_x,
+                            &direction_y, &direction_z, &throughput_r,
+                            &throughput_g, &throughput_b}) {
+                v->resize(capacity);
+            }
+            path.resize(capacity);
+            sampler.resize(capacity);
+        }
+
+        void push(Ray const &ray, Vector3 const &throughput,
+                  std::uint32_t path_index, Sampler const &path_sampler) {
+            origin_x[size] = ray.origin().x();
+            origin_y[size] = ray.origin().y();
+            origin_z[size] = ray.origin().z();
+            direction_x[size] = ray.direction().x();
+            direction_y[size] = ray.direction().y();
+            direction_z[size] = ray.direction().z();
+            throughput_r[size] = throughput.r();
+            throughput_g[size] = throughput.g();
+            throughput_b[size] = throughput.b();
+            path[size] = path_index;
+            sampler[size] = path_sampler;
+            ++size;
+        }
+
+        Ray ray(std::size_t i) const {
+            return Ray(Vector3(origin_x[i], origin_y[i], origin_z[i]),
+                       Vector3(direction_x[i], direction_y[i], direction_z[i]));
+        }
+
+        Vector3 throughput(std::size_t i) const {
+            return Vector3(throughput_r[i], throughput_g[i], throughput_b[i]);
+        }
+    };
+
+    /// Scratch space, kept per thread so that consecutive tiles reuse it.
+    struct Buffers {
+        PathQueue current;
+        PathQueue next;
+        std::vector<HitRecord> hits;
+        std::vector<std::uint32_t> by_type[3];
+        /// Pixel and color of every path of the wave.
+        std::vector<std::uint32_t> path_pixel;
+        std::vector<Vector3> path_color;
+    };
+
+    /// Scatter the hits at indices, all of material type type, and queue
+    /// the surviving paths in next.
+    template <typename ScatterFunction>
+    static void shade(PathQueue &current, PathQueue &next,
+                      std::vector<HitRecord> const &hits,
+                      std::vector<std::uint32_t> const &indices,
+                      MaterialType type, int bounces,
+                      ScatterFunction &&scatter_hit);
+
+    std::size_t wave_size;
+};
+
+template <typename World>
+void WavefrontIntegrator::render_tile(Tile const &tile, Camera const &cam,
+                                      World const &world,
+                                      RenderSettings const &settings,
+                                      SampleRequest const &request,
+                                      TileAccumulator &accumulator) const {
+    int const tile_width = tile.x_end - tile.x_begin;
+    std::size_t const tile_pixels =
+        std::size_t(tile_width * (tile.y_end - tile.y_begin));
+    if (tile_pixels == 0 || request.end <= request.begin) {
+        return;
+    }
+    int const samples_per_wave =
+        int(std::max<std::size_t>(1, wave_size / tile_pixels));
+    std::size_t const capacity =
+        tile_pixels *
+        std::size_t(std::min(samples_per_wave, request.end - request.begin));
+
+    thread_local Buffers buffers;
+    if (buffers.current.path.size() < capacity) {
+        buffers.current.reserve(capacity);
+        buffers.next.reserve(capacity);
+        buffers.hits.resize(capacity);
+        buffers.path_pixel.resize(capacity);
+        buffers.path_color.resize(capacity);
+    }
+    PathQueue *current = &buffers.current;
+    PathQueue *next = &buffers.next;
+
+    for (int s_begin = request.begin; s_begin < request.end;
+         s_begin += samples_per_wave) {
+        int const s_end = std::min(request.end, s_begin + samples_per_wave);
+        // Generate the camera rays of the wave, pixel by pixel and in sample
+        // order within a pixel.
+        current->size = 0;
+        for (int j = tile.y_begin; j != tile.y_end; ++j) {
+            for (int i = tile.x_begin; i != tile.x_end; ++i) {
+                auto const pixel = std::uint32_t(
+                    (j - tile.y_begin) * tile_width + (i - tile.x_begin));
+                if (!request.is_active(pixel)) {
+                    continue;
+                }
+                for (int s = s_begin; s != s_end; ++s) {
+                    Sampler sampler = pixel_sampler(settings, i, j, s);
+                    auto const [du, dv] = sampler.next_2d();
+                    auto u = (float(i) + du) / float(settings.width);
+                    auto v = (float(j) + dv) / float(settings.height);
+                    auto const path = std::uint32_t(current->size);
+                    buffers.path_pixel[path] = pixel;
+                    buffers.path_color[path] = Vector3(0.0f, 0.0f, 0.0f);
+                    current->push(cam.get_ray(u, v),
+                                  Vector3(1.0f, 1.0f, 1.0f), path, sampler);
+                }
+            }
+        }
+
+        std::size_t const paths = current->size;
+        for (int depth = 0; current->size != 0; ++depth) {
+            for (auto &indices : buffers.by_type) {
+                indices.clear();
+            }
+            // Extend: find the nearest hit of every path. Escaped paths pick
+            // up the sky color, which is the only contribution a path makes;
+            // paths at the depth limit end up black.
+            TRACEY_STAT(ThreadStats &stats = thread_stats();
+                        (depth == 0 ? stats.primary_rays : stats.secondary_rays)
+                            .add(current->size);)
+            for (std::size_t p = 0; p != current->size; ++p) {
+                Ray const ray = current->ray(p);
+                HitRecord &record = buffers.hits[p];
+                if (world.hit(ray, 0.001f, std::numeric_limits<float>::max(),
+                              record)) {
+                    if (depth < max_depth) {
+                        buffers.by_type[int(material_type(world, record))]
+                            .push_back(std::uint32_t(p));
+                    } else {
+                        TRACEY_STAT(stats.add_path(depth);)
+                    }
+                } else {
+                    TRACEY_STAT(stats.add_path(depth);)
+                    buffers.path_color[current->path[p]] =
+                        current->throughput(p) * sky_color(ray);
+                }
+            }
+            // Shade: one pass per material type.
+            next->size = 0;
+            shade(*current, *next, buffers.hits,
+                  buffers.by_type[int(MaterialType::lambertian)],
+                  MaterialType::lambertian, depth + 1,
+                  [](HitRecord const &record, Ray const &ray,
+                     Vector3 &attenuation, Ray &scattered, Sampler &sampler) {
+                      return static_cast<Lambertian const *>(record.material)
+                          ->Lambertian::scatter(ray, record, attenuation,
+                                                scattered, sampler);
+                  });
+            shade(*current, *next, buffers.hits,
+                  buffers.by_type[int(MaterialType::metal)],
+                  MaterialType::metal, depth + 1,
+                  [](HitRecord const &record, Ray const &ray,
+                     Vector3 &attenuation, Ray &scattered, Sampler &sampler) {
+                      return static_cast<Metal const *>(record.material)
+                          ->Metal::scatter(ray, record, attenuation, scattered,
+                                           sampler);
+                  });
+            shade(*current, *next, buffers.hits,
+                  buffers.by_type[int(MaterialType::other)],
+                  MaterialType::other, depth + 1,
+                  [&](HitRecord const &record, Ray const &ray,
+                      Vector3 &attenuation, Ray &scattered, Sampler &sampler) {
+                      return scatter(world, ray, record, attenuation,
+                                     scattered, sampler);
+                  });
+            std::swap(current, next);
+        }
+        for (std::size_t p = 0; p != paths; ++p) {
+            accumulator.add(buffers.path_pixel[p], buffers.path_color[p]);
+        }
+    }
+}
+
+template <typename ScatterFunction>
+void WavefrontIntegrator::shade(PathQueue &current, PathQueue &next,
+                                std::vector<HitRecord> const &hits,
+                                std::vector<std::uint32_t> const &indices,
+                                [[maybe_unused]] MaterialType type,
+                                int bounces, ScatterFunction &&scatter_hit) {
+    TRACEY_STAT(ThreadStats &stats = thread_stats();)
+    for (std::uint32_t p : indices) {
+        Ray scattered;
+        Vector3 attenuation;
+        Sampler sampler = current.sampler[p];
+        if (!scatter_hit(hits[p], current.ray(p), attenuation, scattered,
+                         sampler)) {
+            TRACEY_STAT(stats.add_path(bounces - 1);)
+            continue;
+        }
+        TRACEY_STAT(stats.add_scatter(type);)
+        Vector3 throughput = current.throughput(p) * attenuation;
+        if (russian_roulette(throughput, bounces, sampler)) {
+            next.push(scattered, throughput, current.path[p], sampler);
+        } else {
+            TRACEY_STAT(stats.add_path(bounces - 1);)
+        }
+    }
+}